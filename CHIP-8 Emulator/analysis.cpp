@@ -0,0 +1,82 @@
+#include "analysis.h"
+
+#include <cstring>
+#include <vector>
+
+static void set_bit(uint8_t* bits, uint16_t address)
+{
+	uint32_t n = uint32_t(address) - MEMORY_START_ADRESS;
+	bits[n / 8] |= 1u << (n & 7u);
+}
+
+void analyze_rom(const uint8_t* data, size_t size, rom_analysis& out)
+{
+	memset(&out, 0, sizeof(out));
+
+	uint8_t memory[4096]{};
+	memcpy(memory + MEMORY_START_ADRESS, data, size < PROGRAM_SIZE ? size : PROGRAM_SIZE);
+
+	// addresses some path gets to, each one also starts a block
+	std::vector<uint16_t> pending;
+	auto reach = [&](uint16_t address)
+	{
+		if (address < MEMORY_START_ADRESS || address + 1u >= sizeof(memory))
+			return;
+		if (out.starts_block(address))
+			return;
+		set_bit(out.blocks, address);
+		out.block_count++;
+		pending.push_back(address);
+	};
+	reach(MEMORY_START_ADRESS);
+
+	while (!pending.empty())
+	{
+		uint16_t pc = pending.back();
+		pending.pop_back();
+
+		// straight line code up to the first instruction that ends a block
+		bool ended = false;
+		while (!ended && pc + 1u < sizeof(memory) && !out.is_code(pc))
+		{
+			instruction ins = decode_instruction((memory[pc] << 8u) | memory[pc + 1]);
+			if (ins.id == opcode_id::INVALID)
+				break;
+
+			set_bit(out.code, pc);
+			out.fused[(pc - MEMORY_START_ADRESS) / 2] |= (uint8_t)find_fusion(memory, pc) << ((pc & 1u) * 4u);
+			out.instructions++;
+
+			uint16_t next = pc + 2;
+			switch (ins.id)
+			{
+			case opcode_id::OP_1nnn:
+				reach(ins.nnn);
+				ended = true;
+				break;
+			case opcode_id::OP_2nnn:
+				reach(ins.nnn);
+				reach(next);
+				ended = true;
+				break;
+			case opcode_id::OP_00EE:
+			case opcode_id::OP_Bnnn:
+				ended = true;
+				break;
+			case opcode_id::OP_3xkk: case opcode_id::OP_4xkk: case opcode_id::OP_5xy0:
+			case opcode_id::OP_9xy0: case opcode_id::OP_Ex9E: case opcode_id::OP_ExA1:
+				reach(next);
+				reach(next + 2);
+				ended = true;
+				break;
+			case opcode_id::OP_Fx0A: case opcode_id::OP_Fx33: case opcode_id::OP_Fx55:
+				reach(next);
+				ended = true;
+				break;
+			default:
+				break;
+			}
+			pc = next;
+		}
+	}
+}
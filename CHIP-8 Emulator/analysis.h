@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.h"
+
+/*
+	What can be told about a rom without running it, found by following
+	every path from 0x200:
+	- which addresses hold an instruction that can be reached, everything
+	  else is taken for data
+	- where basic blocks start, cut the same way chip8_jit cuts them
+	- which of the instructions start a superinstruction (fusion_id)
+	Targets of Bnnn depend on V0 and aren't followed, code only reached
+	through one counts as data. Bit and nibble n are for address 0x200 + n.
+*/
+struct rom_analysis
+{
+	uint8_t code[PROGRAM_SIZE / 8];
+	uint8_t blocks[PROGRAM_SIZE / 8];
+	// low nibble for the even address
+	uint8_t fused[PROGRAM_SIZE / 2];
+	uint16_t instructions;
+	uint16_t block_count;
+
+	bool is_code(uint16_t address) const { return bit(code, address); }
+	bool starts_block(uint16_t address) const { return bit(blocks, address); }
+	fusion_id fusion(uint16_t address) const
+	{
+		uint32_t n = uint32_t(address) - MEMORY_START_ADRESS;
+		return n < PROGRAM_SIZE ? fusion_id((fused[n / 2] >> (n & 1u) * 4u) & 0xFu) : fusion_id::NONE;
+	}
+
+private:
+	static bool bit(const uint8_t* bits, uint16_t address)
+	{
+		uint32_t n = uint32_t(address) - MEMORY_START_ADRESS;
+		return n < PROGRAM_SIZE && (bits[n / 8] >> (n & 7u)) & 1u;
+	}
+};
+
+// Goes up whenever decode, find_fusion or analyze_rom start finding
+// something else. Analyses kept around from another version (see
+// rom_database) would have run() fuse code that no longer matches
+#define ROM_ANALYSIS_VERSION 2
+
+// `size` bytes of rom, as they would be loaded at 0x200
+void analyze_rom(const uint8_t* data, size_t size, rom_analysis& out);
@@ -0,0 +1,69 @@
+#include "audio.h"
+
+#include <algorithm>
+#include <cstring>
+
+audio_ring::audio_ring(uint32_t capacity) : samples(capacity), mask(capacity - 1)
+{
+}
+
+uint32_t audio_ring::queued() const
+{
+	return uint32_t(written.load(std::memory_order_acquire) - read.load(std::memory_order_acquire));
+}
+
+uint32_t audio_ring::push(const int16_t* in, uint32_t count, uint32_t limit)
+{
+	uint64_t at = written.load(std::memory_order_relaxed);
+	uint32_t used = uint32_t(at - read.load(std::memory_order_acquire));
+	limit = std::min(limit, (uint32_t)samples.size());
+	uint32_t fits = used < limit ? std::min(count, limit - used) : 0;
+
+	for (uint32_t i = 0; i < fits; i++)
+		samples[(at + i) & mask] = in[i];
+	written.store(at + fits, std::memory_order_release);
+
+	if (fits < count)
+		dropped.fetch_add(count - fits, std::memory_order_relaxed);
+	return fits;
+}
+
+void audio_ring::pop(int16_t* out, uint32_t count)
+{
+	uint64_t at = read.load(std::memory_order_relaxed);
+	uint32_t available = uint32_t(written.load(std::memory_order_acquire) - at);
+	uint32_t taken = std::min(count, available);
+
+	for (uint32_t i = 0; i < taken; i++)
+		out[i] = samples[(at + i) & mask];
+	read.store(at + taken, std::memory_order_release);
+
+	if (taken < count)
+	{
+		memset(out + taken, 0, (count - taken) * sizeof(int16_t));
+		starved.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void beeper::generate(bool on, double seconds, audio_ring& ring, uint32_t limit)
+{
+	pending += seconds * AUDIO_SAMPLE_RATE;
+	uint32_t count = (uint32_t)pending;
+	pending -= count;
+	if (!count)
+		return;
+
+	scratch.resize(count);
+	double step = frequency / AUDIO_SAMPLE_RATE;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		scratch[i] = on ? (phase < 0.5 ? volume : int16_t(-volume)) : 0;
+		phase += step;
+		if (phase >= 1.0)
+			phase -= 1.0;
+	}
+
+	// a step longer than the limit (the emulation on the ui thread) keeps
+	// all of its samples, the device takes them in the same frame
+	ring.push(scratch.data(), count, std::max(limit, count));
+}
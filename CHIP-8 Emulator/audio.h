@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define AUDIO_SAMPLE_RATE 44100
+
+// 2^n samples, a whole frame of the emulation stepped on the ui thread fits
+#define AUDIO_RING_CAPACITY 4096
+
+// What the ring may hold ahead of the device, 4 ms. Together with the
+// device's own buffers (fm::application::open_audio) that keeps the
+// beeper less than 10 ms behind the sound timer
+#define AUDIO_MAX_QUEUED 176
+
+/*
+	Mono 16 bit samples from the emulation thread to the audio callback.
+	One producer and one consumer, neither of them ever waits: samples
+	that don't fit are dropped and counted as overruns, a callback that
+	finds too few plays silence for the rest and counts an underrun.
+*/
+struct audio_ring
+{
+public:
+	audio_ring(uint32_t capacity = AUDIO_RING_CAPACITY);
+
+	audio_ring(const audio_ring&) = delete;
+	audio_ring& operator=(const audio_ring&) = delete;
+
+	// Producer side. At most `limit` samples are left queued afterwards,
+	// returns how many went in
+	uint32_t push(const int16_t* samples, uint32_t count, uint32_t limit);
+
+	// Consumer side, always writes `count` samples
+	void pop(int16_t* out, uint32_t count);
+
+	uint32_t queued() const;
+
+	// samples dropped by push and callbacks that ran dry, since the start
+	uint64_t overruns() const { return dropped.load(std::memory_order_relaxed); }
+	uint64_t underruns() const { return starved.load(std::memory_order_relaxed); }
+
+private:
+	std::vector<int16_t> samples;
+	uint32_t mask;
+	std::atomic<uint64_t> written{ 0 };
+	std::atomic<uint64_t> read{ 0 };
+	std::atomic<uint64_t> dropped{ 0 };
+	std::atomic<uint64_t> starved{ 0 };
+};
+
+/*
+	The CHIP-8 beeper, a square wave for as long as the sound timer is
+	above 0. The phase carries over between calls so the tone doesn't
+	click at every step.
+*/
+struct beeper
+{
+public:
+	float frequency = 440.0f;
+	int16_t volume = 4000;
+
+	// Pushes `seconds` worth of samples, the tone or silence
+	void generate(bool on, double seconds, audio_ring& ring, uint32_t limit = AUDIO_MAX_QUEUED);
+
+private:
+	double phase = 0.0;
+	double pending = 0.0;
+	std::vector<int16_t> scratch;
+};
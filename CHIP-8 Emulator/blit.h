@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// SSE2 is always there on x64, AVX2 only when the compiler is told to
+// use it (premake5 --avx2 or -mavx2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FM_SSE2 1
+#include <emmintrin.h>
+#else
+#define FM_SSE2 0
+#endif
+
+#if defined(__AVX2__)
+#define FM_AVX2 1
+#include <immintrin.h>
+#else
+#define FM_AVX2 0
+#endif
+
+namespace fm
+{
+	// Writes the first `count` pixels of `src` scaled `s` times horizontally into `dst`
+	inline void expand_row(const uint32_t* src, uint32_t s, uint32_t* dst, uint32_t count)
+	{
+		if (s == 1)
+		{
+			memcpy(dst, src, count * sizeof(uint32_t));
+			return;
+		}
+
+		// source pixels that fit whole, the last one might get cut
+		uint32_t whole = count / s;
+		uint32_t i = 0;
+
+#if FM_SSE2
+		if (s == 2)
+		{
+			for (; i + 4 <= whole; i += 4)
+			{
+				__m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+				_mm_storeu_si128((__m128i*)(dst + i * 2), _mm_unpacklo_epi32(p, p));
+				_mm_storeu_si128((__m128i*)(dst + i * 2 + 4), _mm_unpackhi_epi32(p, p));
+			}
+		}
+		else if (s >= 4)
+		{
+			for (; i < whole; i++)
+			{
+				uint32_t* out = dst + i * s;
+				uint32_t k = 0;
+#if FM_AVX2
+				__m256i wide = _mm256_set1_epi32((int)src[i]);
+				for (; k + 8 <= s; k += 8)
+					_mm256_storeu_si256((__m256i*)(out + k), wide);
+#endif
+				__m128i p = _mm_set1_epi32((int)src[i]);
+				for (; k + 4 <= s; k += 4)
+					_mm_storeu_si128((__m128i*)(out + k), p);
+
+				// the rest overlaps pixels that already got this value
+				if (k < s)
+					_mm_storeu_si128((__m128i*)(out + s - 4), p);
+			}
+		}
+#endif
+
+		for (; i < whole; i++)
+			for (uint32_t k = 0; k < s; k++)
+				dst[i * s + k] = src[i];
+
+		for (uint32_t k = whole * s; k < count; k++)
+			dst[k] = src[whole];
+	}
+
+	/*
+		Draws rows [first_row, first_row + row_count) of a src_w x src_h image
+		into dst, every pixel becoming an s x s block. Same layout as
+		application::draw_framebuffer: dst is bottom-up, so source row i lands
+		at y + (src_h - i) * s. Clipping happens once, then every source row is
+		expanded a single time and copied to the other s - 1 destination rows.
+	*/
+	inline void blit_scaled(uint32_t* dst, uint32_t dst_w, uint32_t dst_h,
+		const uint32_t* src, uint32_t src_w, uint32_t src_h,
+		uint32_t x, uint32_t y, uint32_t s, uint32_t first_row, uint32_t row_count)
+	{
+		if (s == 0 || x >= dst_w || first_row >= src_h)
+			return;
+
+		uint32_t last_row = first_row + row_count < src_h ? first_row + row_count : src_h;
+		uint32_t width = src_w * s < dst_w - x ? src_w * s : dst_w - x;
+
+		for (uint32_t i = first_row; i < last_row; i++)
+		{
+			uint32_t top = y + (src_h - i) * s;
+			if (top >= dst_h)
+				continue;
+			uint32_t rows = s < dst_h - top ? s : dst_h - top;
+
+			uint32_t* first = dst + top * dst_w + x;
+			expand_row(src + i * src_w, s, first, width);
+			for (uint32_t r = 1; r < rows; r++)
+				memcpy(first + r * dst_w, first, width * sizeof(uint32_t));
+		}
+	}
+}
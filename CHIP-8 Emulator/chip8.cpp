@@ -1,34 +1,83 @@
 #include "chip8.h"
+#include "analysis.h"
+#include "jit.h"
+#include "listing.h"
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 
 void chip8::initialize()
 {
-	srand(time(NULL));
+	seed((uint64_t)time(NULL));
 
 	pc = MEMORY_START_ADRESS;
 	load_font();
-	load_instructions();
-	load_ins_name();
 }
 
+void chip8::seed(uint64_t value)
+{
+	random_seed(random_state, value);
+}
+
+// Back to the state right after initialize(), nothing of the last
+// program is left in memory, the registers or on the display
 void chip8::reset()
 {
+	clear_state();
+	invalidate(0, sizeof(memory));
+}
+
+// Everything reset() does but telling the caches
+void chip8::clear_state()
+{
+	memset(registers, 0, sizeof(registers));
+	memset(memory, 0, sizeof(memory));
+	memset(stack, 0, sizeof(stack));
+	memset(keypad, 0, sizeof(keypad));
+
 	pc = MEMORY_START_ADRESS;
 	index = 0;
 	stack_pointer = 0;
 	delay_timer = 0;
 	sound_timer = 0;
 
+	clear_display();
+	load_font();
 }
 void chip8::cycle()
 {
-	opcode = (memory[pc] << 8u) | memory[pc + 1];
-	pc += 2;
+	// addresses outside of program memory are not cached,
+	// they get decoded every time
+	uint16_t slot = pc - MEMORY_START_ADRESS;
+	if (slot < PROGRAM_SIZE - 1)
+	{
+		instruction& ins = decoded[slot].decoded ? decoded[slot] : decode_slot(slot);
+#if CHIP8_PROFILE
+		profile.count(pc, ins.id);
+#endif
+		pc += 2;
+
+		(this->*handlers[(uint32_t)ins.id])(ins);
+	}
+	else
+	{
+		uint16_t opcode = (memory[pc] << 8u) | memory[pc + 1];
+#if CHIP8_PROFILE
+		profile.count(pc, decode(opcode));
+#endif
+		pc += 2;
 
-	execute_instuction(opcode);
+		execute_instuction(opcode);
+	}
+}
 
+// Called 60 times per emulated second by the scheduler
+void chip8::tick_timers()
+{
 	if (delay_timer > 0)
 		delay_timer--;
 
@@ -38,22 +87,79 @@ void chip8::cycle()
 
 void chip8::load_rom(const std::string& filepath)
 {
-	reset();
-	FILE* file;
-	int length;
-
-	fopen_s(&file, filepath.c_str(), "rb");
+	FILE* file = fopen(filepath.c_str(), "rb");
 	if (file == NULL)
+	{
+		reset();
 		return;
+	}
+
+	// whatever doesn't fit in memory is left out
+	uint8_t rom[PROGRAM_SIZE];
+	size_t length = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+
+	load_rom(rom, length);
+}
+
+void chip8::load_rom(const uint8_t* data, size_t size)
+{
+	clear_state();
+	memcpy(&memory[MEMORY_START_ADRESS], data, size < PROGRAM_SIZE ? size : PROGRAM_SIZE);
+	invalidate(0, sizeof(memory));
+}
 
-	fseek(file, 0, SEEK_END);
-	length = ftell(file);
+// Drops the decoded form of every instruction that overlaps [address, address + length)
+void chip8::invalidate(uint16_t address, uint16_t length)
+{
+	if (jit)
+		jit->invalidate(address, length);
+	if (listing)
+		listing->patch(memory, address, length);
 
-	if (length <= 0)
+	uint32_t first = address < MEMORY_START_ADRESS ? MEMORY_START_ADRESS : address;
+	uint32_t last = address + length > sizeof(memory) ? sizeof(memory) : address + length;
+	if (first >= last)
 		return;
 
-	fseek(file, 0, SEEK_SET);
-	fread(&memory[MEMORY_START_ADRESS], 1, length, file);
+	first -= MEMORY_START_ADRESS;
+	last -= MEMORY_START_ADRESS;
+
+	// the instruction starting one byte before overlaps the first written
+	// byte, and a superinstruction may start up to two instructions earlier
+	first = first >= 5 ? first - 5 : 0;
+	for (uint32_t i = first; i < last; i++)
+		decoded[i].decoded = 0;
+}
+
+void chip8::predecode(const rom_analysis& analysis)
+{
+	// 8 addresses per byte of the code map, most of a rom is data or empty
+	for (uint32_t byte = 0; byte < PROGRAM_SIZE / 8; byte++)
+		for (uint32_t bits = analysis.code[byte]; bits; bits &= bits - 1)
+		{
+			uint32_t slot = byte * 8 + std::countr_zero(bits);
+			uint16_t address = MEMORY_START_ADRESS + slot;
+
+			// the analysis may come out of a file, a hint that isn't a
+			// fusion_id or isn't what is in memory would have run() jump
+			// nowhere or read past the end. Those slots get decoded the
+			// first time they run instead
+			fusion_id fusion = analysis.fusion(address);
+			if (fusion >= fusion_id::COUNT || fusion != find_fusion(memory, address))
+				continue;
+			decoded[slot] = decode_fused(memory, address, fusion);
+		}
+}
+
+// Decodes an entry of the instruction cache and checks whether it starts
+// one of the sequences in fusion_id
+instruction& chip8::decode_slot(uint32_t slot)
+{
+	uint16_t address = MEMORY_START_ADRESS + slot;
+	instruction& ins = decoded[slot];
+	ins = decode_fused(memory, address, find_fusion(memory, address));
+	return ins;
 }
 
 void chip8::load_font()
@@ -84,139 +190,133 @@ void chip8::load_font()
 }
 
 // Sets the display to black (0)
-void chip8::op_00E0()
+void chip8::op_00E0(const instruction& ins)
 {
-	memset(display, 0x00000000, sizeof(display));
+	clear_display();
 }
 
 // Goes to the previous instruction in the stack
-void chip8::op_00EE()
+void chip8::op_00EE(const instruction& ins)
 {
 	--stack_pointer;
-	pc = stack[stack_pointer];
+	pc = stack[stack_pointer & 0xFu];
 }
 
 // Sets program counter (pc) to the new adress, no need to 
 // interact with the stack
-void chip8::op_1nnn()
+void chip8::op_1nnn(const instruction& ins)
 {
-	// 0x0FFFu = 0b1111111111
-	uint16_t adress = opcode & 0x0FFFu;
+	uint16_t adress = ins.nnn;
 	pc = adress;
 }
 
 // Sets program counter (pc) to the new adress and saves the 
 // last adress in the stack
-void chip8::op_2nnn()
+void chip8::op_2nnn(const instruction& ins)
 {
-	uint16_t adress = opcode & 0x0FFFu;
+	uint16_t adress = ins.nnn;
 	
-	stack[stack_pointer++] = pc;
+	// a program that keeps calling wraps around the 16 levels
+	// instead of writing past the stack
+	stack[stack_pointer++ & 0xFu] = pc;
 	pc = adress;
 }
 
 // If the condision is met, program counter (pc) gets
 // incremented by 2 so we skip the next instruction
-void chip8::op_3xkk()
+void chip8::op_3xkk(const instruction& ins)
 {
-	// gets 4 bits from the left of the binary number
-	// and shift them right 8 times
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t kk = opcode & 0x00FFu;
+	uint8_t Vx = ins.x;
+	uint8_t kk = ins.kk;
 
 	if (registers[Vx] == kk)
 		pc += 2;
 }
 
 // Same as above
-void chip8::op_4xkk()
+void chip8::op_4xkk(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t kk = opcode & 0x00FFu;
+	uint8_t Vx = ins.x;
+	uint8_t kk = ins.kk;
 
 	if (registers[Vx] != kk)
 		pc += 2;
 }
 
 // Same as above
-void chip8::op_5xy0()
+void chip8::op_5xy0(const instruction& ins)
 {
-	// gets 4 bits from the left of the binary number
-	// and shift them right 8 times
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-	// gets 4 bits from the middle of the binary number
-	// and shift them right 4 times
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 
 	if (registers[Vx] == registers[Vy])
 		pc += 2;
 }
 
-void chip8::op_6xkk()
+void chip8::op_6xkk(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t kk = opcode & 0x00FFu;
+	uint8_t Vx = ins.x;
+	uint8_t kk = ins.kk;
 	registers[Vx] = kk;
 }
 
-void chip8::op_7xkk()
+void chip8::op_7xkk(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t kk = opcode & 0x00FFu;
+	uint8_t Vx = ins.x;
+	uint8_t kk = ins.kk;
 	registers[Vx] += kk;
 }
 
-void chip8::op_8xy0()
+void chip8::op_8xy0(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 	registers[Vx] = registers[Vy];
 }
 
-void chip8::op_8xy1()
+void chip8::op_8xy1(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 	registers[Vx] |= registers[Vy];
 }
 
-void chip8::op_8xy2()
+void chip8::op_8xy2(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 	registers[Vx] &= registers[Vy];
 }
 
-void chip8::op_8xy3()
+void chip8::op_8xy3(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 	registers[Vx] ^= registers[Vy];
 }
 
-void chip8::op_8xy4()
+void chip8::op_8xy4(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 	uint8_t sum = registers[Vx] + registers[Vy];
 
 	registers[VF] = (sum > 255U);
 	registers[Vx] = sum & 0xFFu; // % 256
 }
 
-void chip8::op_8xy5()
+void chip8::op_8xy5(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 
 	registers[VF] = (registers[Vx] > registers[Vy]);
 	registers[Vx] -= registers[Vy];
 }
 
-void chip8::op_8xy6()
+void chip8::op_8xy6(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 
 	// Gets the least significant bit
 	registers[VF] = registers[Vx] & 0x1u;
@@ -224,18 +324,18 @@ void chip8::op_8xy6()
 	registers[Vx] >>= registers[Vx];
 }
 
-void chip8::op_8xy7()
+void chip8::op_8xy7(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 
 	registers[VF] = (registers[Vy] > registers[Vx]);
 	registers[Vx] = registers[Vy] - registers[Vx];
 }
 
-void chip8::op_8xyE()
+void chip8::op_8xyE(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 
 	// Gets the most significant bit
 	registers[VF] = (registers[Vx] & 0x80u) >> 7u;
@@ -243,95 +343,102 @@ void chip8::op_8xyE()
 	registers[Vx] <<= registers[Vx];
 }
 
-void chip8::op_9xy0()
+void chip8::op_9xy0(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
 
 	if (registers[Vx] != registers[Vy])
 		pc += 2;
 }
 
-void chip8::op_Annn()
+void chip8::op_Annn(const instruction& ins)
 {
-	uint16_t address = opcode & 0x0FFFu;
+	uint16_t address = ins.nnn;
 	index = address;
 }
 
-void chip8::op_Bnnn()
+void chip8::op_Bnnn(const instruction& ins)
 {
-	uint16_t address = opcode & 0x0FFFu;
+	uint16_t address = ins.nnn;
 	pc = registers[0] + address;
 }
 
-void chip8::op_Cxkk()
+void chip8::op_Cxkk(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t kk = opcode & 0x00FFu;
-	uint8_t rnd = rand() % 256;
+	uint8_t Vx = ins.x;
+	uint8_t kk = ins.kk;
+	uint8_t rnd = random_byte(random_state);
 
 	registers[Vx] = rnd & kk;
 }
 
-void chip8::op_Dxyn()
+void chip8::op_Dxyn(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-	uint8_t height = opcode & 0x000Fu;
+	uint8_t Vx = ins.x;
+	uint8_t Vy = ins.y;
+	uint8_t height = ins.n;
 
 	uint8_t x_pos = registers[Vx] % SCREEN_WIDTH;
 	uint8_t y_pos = registers[Vy] % SCREEN_HEIGHT;
 
 	registers[VF] = 0;
 
+	// sprites are clipped at the bottom
+	if (y_pos + height > SCREEN_HEIGHT)
+		height = SCREEN_HEIGHT - y_pos;
+
+	uint32_t changed = 0;
 	for (uint32_t y = 0; y < height; y++)
 	{
-		uint8_t sprite_byte = memory[index + y];
-		for (uint32_t x = 0; x < 8; x++)
-		{
-			// gets every byte from the current row
-			uint8_t sprite_pixel = sprite_byte & (0x80u >> x);
-
-			// if the current pixel is white
-			if (sprite_pixel && x_pos + x < 64 && y_pos + y < 32) 
-			{
-				uint32_t& screen_pixel = display[(y_pos + y) * SCREEN_WIDTH + (x_pos + x)];
-				// collision
-				if (screen_pixel == 0xFFFFFFFF)
-					registers[VF] = 1;
-				screen_pixel ^= 0xFFFFFFFF;
-			}
-		}
+		// moves the sprite row to its place on the screen row, whatever
+		// goes past the right edge gets shifted out
+		uint64_t sprite_row = (uint64_t)memory[index + y] << 56u >> x_pos;
+		uint64_t& screen_row = display[y_pos + y];
+
+		// collision
+		if (screen_row & sprite_row)
+			registers[VF] = 1;
+		screen_row ^= sprite_row;
+
+		if (sprite_row)
+			changed |= 1u << (y_pos + y);
+	}
+
+	if (changed)
+	{
+		dirty_rows |= changed;
+		display_generation++;
 	}
 }
 
-void chip8::op_Ex9E()
+void chip8::op_Ex9E(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	uint8_t key = registers[Vx];
 
 	if (keypad[key])
 		pc += 2;
 }
 
-void chip8::op_ExA1()
+void chip8::op_ExA1(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	uint8_t key = registers[Vx];
 
 	if (!keypad[key])
 		pc += 2;
 }
 
-void chip8::op_Fx07()
+void chip8::op_Fx07(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	registers[Vx] = delay_timer;
 }
 
-void chip8::op_Fx0A()
+void chip8::op_Fx0A(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 
 	bool key_pressed = false;
 	for(uint8_t i = 0; i < 16; i++)
@@ -346,34 +453,34 @@ void chip8::op_Fx0A()
 
 }
 
-void chip8::op_Fx15()
+void chip8::op_Fx15(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	delay_timer = registers[Vx];
 }
 
-void chip8::op_Fx18()
+void chip8::op_Fx18(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	sound_timer = registers[Vx];
 }
 
-void chip8::op_Fx1E()
+void chip8::op_Fx1E(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	index += registers[Vx];
 }
 
-void chip8::op_Fx29()
+void chip8::op_Fx29(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	uint8_t digit = registers[Vx];
 	index = FONTSET_START_ADRESS + (5 * digit);
 }
 
-void chip8::op_Fx33()
+void chip8::op_Fx33(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	uint8_t value = registers[Vx];
 
 	memory[index + 2] = value % 10;
@@ -383,126 +490,93 @@ void chip8::op_Fx33()
 	value /= 10;
 
 	memory[index] = value % 10;
+
+	invalidate(index, 3);
 }
 
-void chip8::op_Fx55()
+void chip8::op_Fx55(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	for (int i = 0; i <= Vx; i++)
 		memory[index + i] = registers[i];
+
+	invalidate(index, Vx + 1);
 }
 
-void chip8::op_Fx65()
+void chip8::op_Fx65(const instruction& ins)
 {
-	uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+	uint8_t Vx = ins.x;
 	for (int i = 0; i <= Vx; i++)
 		registers[i] = memory[index + i];
 }
 
-void chip8::load_instructions()
-{
-	instructions[0x00E0] = &chip8::op_00E0;
-	instructions[0x00EE] = &chip8::op_00EE;
-	instructions[0x1000] = &chip8::op_1nnn;
-	instructions[0x2000] = &chip8::op_2nnn;
-	instructions[0x3000] = &chip8::op_3xkk;
-	instructions[0x4000] = &chip8::op_4xkk;
-	instructions[0x5000] = &chip8::op_5xy0;
-	instructions[0x6000] = &chip8::op_6xkk;
-	instructions[0x7000] = &chip8::op_7xkk;
-	instructions[0x8000] = &chip8::op_8xy0;
-	instructions[0x8001] = &chip8::op_8xy1;
-	instructions[0x8002] = &chip8::op_8xy2;
-	instructions[0x8003] = &chip8::op_8xy3;
-	instructions[0x8004] = &chip8::op_8xy4;
-	instructions[0x8005] = &chip8::op_8xy5;
-	instructions[0x8006] = &chip8::op_8xy6;
-	instructions[0x8007] = &chip8::op_8xy7;
-	instructions[0x800E] = &chip8::op_8xyE;
-	instructions[0x9000] = &chip8::op_9xy0;
-	instructions[0xA000] = &chip8::op_Annn;
-	instructions[0xB000] = &chip8::op_Bnnn;
-	instructions[0xC000] = &chip8::op_Cxkk;
-	instructions[0xD000] = &chip8::op_Dxyn;
-	instructions[0xE00E] = &chip8::op_Ex9E;
-	instructions[0xE001] = &chip8::op_ExA1;
-	instructions[0xF007] = &chip8::op_Fx07;
-	instructions[0xF00A] = &chip8::op_Fx0A;
-	instructions[0xF015] = &chip8::op_Fx15;
-	instructions[0xF018] = &chip8::op_Fx18;
-	instructions[0xF01E] = &chip8::op_Fx1E;
-	instructions[0xF029] = &chip8::op_Fx29;
-	instructions[0xF033] = &chip8::op_Fx33;
-	instructions[0xF055] = &chip8::op_Fx55;
-	instructions[0xF065] = &chip8::op_Fx65;
-}
-
-void chip8::load_ins_name()
-{
-	ins_names[0x00E0] = "CLS";
-	ins_names[0x00EE] = "RET";
-	ins_names[0x1000] = "JP addr";
-	ins_names[0x2000] = "CALL addr";
-	ins_names[0x3000] = "SE Vx, byte";
-	ins_names[0x4000] = "SNE Vx, byte";
-	ins_names[0x5000] = "SE Vx, Vy";
-	ins_names[0x6000] = "LD Vx, byte";
-	ins_names[0x7000] = "ADD Vx, byte";
-	ins_names[0x8000] = "LD Vx, Vy";
-	ins_names[0x8001] = "OR Vx, Vy";
-	ins_names[0x8002] = "AND Vx, Vy";
-	ins_names[0x8003] = "XOR Vx, Vy";
-	ins_names[0x8004] = "ADD Vx, Vy";
-	ins_names[0x8005] = "SUB Vx, Vy";
-	ins_names[0x8006] = "SHR Vx [, Vy]";
-	ins_names[0x8007] = "SUBN Vx, Vy";
-	ins_names[0x800E] = "SHL Vx [, Vy]";
-	ins_names[0x9000] = "SNE Vx, Vy";
-	ins_names[0xA000] = "LD I, addr";
-	ins_names[0xB000] = "JP V0, addr";
-	ins_names[0xC000] = "RND Vx, byte";
-	ins_names[0xD000] = "DRW Vx, Vy, nibble";
-	ins_names[0xE00E] = "SKP Vx";
-	ins_names[0xE001] = "SKNP Vx";
-	ins_names[0xF007] = "LD Vx, DT";
-	ins_names[0xF00A] = "LD Vx, K";
-	ins_names[0xF015] = "LD DT, Vx";
-	ins_names[0xF018] = "LD ST, Vx";
-	ins_names[0xF01E] = "ADD I, Vx";
-	ins_names[0xF029] = "LD F, Vx";
-	ins_names[0xF033] = "LD B, Vx";
-	ins_names[0xF055] = "LD [I], Vx";
-	ins_names[0xF065] = "LD Vx, [I]";
+void chip8::op_invalid(const instruction& ins)
+{
+	// not memory[pc - 2], the instruction may not come from memory at pc (micro benchmarks, lanes)
+	uint16_t opcode = (ins.high << 12u) | ins.nnn;
+	std::cout << "instruction doesnt exist: " << opcode << "\n";
 }
 
+const func chip8::handlers[(uint32_t)opcode_id::COUNT] = {
+	&chip8::op_00E0, &chip8::op_00EE, &chip8::op_1nnn, &chip8::op_2nnn,
+	&chip8::op_3xkk, &chip8::op_4xkk, &chip8::op_5xy0, &chip8::op_6xkk,
+	&chip8::op_7xkk, &chip8::op_8xy0, &chip8::op_8xy1, &chip8::op_8xy2,
+	&chip8::op_8xy3, &chip8::op_8xy4, &chip8::op_8xy5, &chip8::op_8xy6,
+	&chip8::op_8xy7, &chip8::op_8xyE, &chip8::op_9xy0, &chip8::op_Annn,
+	&chip8::op_Bnnn, &chip8::op_Cxkk, &chip8::op_Dxyn, &chip8::op_Ex9E,
+	&chip8::op_ExA1, &chip8::op_Fx07, &chip8::op_Fx0A, &chip8::op_Fx15,
+	&chip8::op_Fx18, &chip8::op_Fx1E, &chip8::op_Fx29, &chip8::op_Fx33,
+	&chip8::op_Fx55, &chip8::op_Fx65,
+	&chip8::op_invalid
+};
+
 void chip8::execute_instuction(uint16_t opcode)
 {
-	uint16_t code = (0xF0FF & opcode);
-	if (instructions.find(code) == instructions.end())
-		code = (code & 0xFF0F);
-	if (instructions.find(code) == instructions.end())
-		code = (code & 0xFFF0);
-	if (instructions.find(code) == instructions.end())
+	instruction ins = decode_instruction(opcode);
+	(this->*handlers[(uint32_t)ins.id])(ins);
+}
+
+std::string_view chip8::get_instruction_name(uint16_t opcode) const
+{
+	return instruction_names[(uint32_t)decode(opcode)];
+}
+
+void chip8::get_pixels(uint32_t* pixels, uint32_t rows) const
+{
+	for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
 	{
-		std::cout << "instruction doesnt exist: " << code << "\n";
-		return;
+		if (!(rows & (1u << y)))
+			continue;
+		for (uint32_t x = 0; x < SCREEN_WIDTH; x++)
+			pixels[y * SCREEN_WIDTH + x] = (display[y] >> (63u - x)) & 1u ? 0xFFFFFFFF : 0x00000000;
 	}
-
-	(this->*(instructions[code]))();
 }
 
-std::string chip8::get_instruction_name(uint16_t opcode)
+uint64_t chip8::display_hash() const
 {
-	uint16_t code = (0xF0FF & opcode);
-	if (instructions.find(code) == instructions.end())
-		code = (code & 0xFF0F);
-	if (instructions.find(code) == instructions.end())
-		code = (code & 0xFFF0);
-	if (instructions.find(code) == instructions.end())
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const uint8_t* bytes = (const uint8_t*)display;
+	for (uint32_t i = 0; i < sizeof(display); i++)
 	{
-		std::cout << "instruction doesnt exist: " << code << "\n";
-		return "";
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
 	}
+	return hash;
+}
+
+// Only the rows that weren't already black count as changed
+void chip8::clear_display()
+{
+	uint32_t changed = 0;
+	for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
+		if (display[y])
+			changed |= 1u << y;
 
-	return ins_names[code];
+	memset(display, 0x00000000, sizeof(display));
+
+	if (changed)
+	{
+		dirty_rows |= changed;
+		display_generation++;
+	}
 }
@@ -1,8 +1,11 @@
 #pragma once
 #include <cstdint>
-#include <functional>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+
+#include "decode.h"
+#include "profile.h"
+#include "random.h"
 
 #define MEMORY_START_ADRESS 0x200
 #define FONTSET_START_ADRESS 0x050
@@ -10,18 +13,19 @@
 #define VF 0xF
 #define SCREEN_WIDTH 64
 #define SCREEN_HEIGHT 32
+#define PROGRAM_SIZE (4096 - MEMORY_START_ADRESS)
 
 struct chip8;
+struct chip8_jit;
+struct trace_ring;
+struct rom_listing;
+struct rom_analysis;
 
-typedef void (chip8::*func)();
-typedef std::unordered_map<uint16_t, func> instruction_table;
+typedef void (chip8::*func)(const instruction&);
 
 // Check progress.txt for more informations
 struct chip8
 {
-	// Opcode
-	uint16_t opcode{};
-
 	// 16 8 - Bit registers
 	uint8_t registers[16]{};
 
@@ -49,60 +53,133 @@ struct chip8
 	// 16 Input Keys
 	uint8_t keypad[16]{};
 
-	// 64x32 display
-	uint32_t display[64 * 32]{};
+	// 64x32 display, one bit per pixel. Every row is a 64 bit word with
+	// the leftmost pixel (x = 0) in the highest bit
+	uint64_t display[SCREEN_HEIGHT]{};
+
+	// Bit y is set when row y of the display changed, cleared by whoever
+	// hands the display on (emulation::publish)
+	uint32_t dirty_rows = 0xFFFFFFFF;
+
+	// Goes up every time an instruction changes the display, lets more
+	// than one reader tell if there is a new frame without the dirty bits
+	uint32_t display_generation = 0;
+
+	// xoshiro128** state for Cxkk, see random.h
+	uint32_t random_state[4]{};
 
+	// Seeds Cxkk from the clock, call seed() afterwards for a run that repeats
 	void initialize();
+	void seed(uint64_t value);
 	void reset();
 	void load_rom(const std::string& filepath);
+	// Same as the file version, for roms that are already in memory (see
+	// rom_library). Anything past the program area is left out
+	void load_rom(const uint8_t* data, size_t size);
+	// Decodes every instruction `analysis` found in the rom that was just
+	// loaded, with the superinstructions it found, so run() doesn't stop
+	// to do it the first time through. Hints that don't match memory are
+	// left out, see analysis.h
+	void predecode(const rom_analysis& analysis);
 	void execute_instuction(uint16_t opcode);
-	std::string get_instruction_name(uint16_t opcode);
+	std::string_view get_instruction_name(uint16_t opcode) const;
 
+	// Expands the display to 64 * 32 ARGB pixels (white or black),
+	// only the rows set in `rows` are written
+	void get_pixels(uint32_t* pixels, uint32_t rows = 0xFFFFFFFF) const;
+	void clear_display();
+
+	// FNV-1a over the display rows, for telling two runs apart
+	uint64_t display_hash() const;
+
+	// Executes one instruction, the timers are left alone
 	void cycle();
 
+	// Counts both timers down by one, see scheduler.h
+	void tick_timers();
+
+	// Executes `cycles` instructions in one go, with the same result as
+	// calling cycle() that many times. See chip8_run.cpp
+	void run(uint64_t cycles);
+
+	// Must be called after writing into memory so the decoded
+	// instructions don't go stale
+	void invalidate(uint16_t address, uint16_t length);
+
+	// Writes everything but the caches into `buffer` (STATE_SIZE bytes)
+	// and returns how much it wrote. See savestate.h for the format
+	size_t save_state(uint8_t* buffer) const;
+
+	// False, with nothing changed, when the buffer isn't a state this
+	// version can read
+	bool load_state(const uint8_t* buffer, size_t size);
+
+	// Instructions run() executed as part of a superinstruction
+	uint64_t fused_instructions = 0;
+
+	// Set while a chip8_jit is attached, so writes reach its translated blocks
+	chip8_jit* jit = nullptr;
+
+	// While set run() goes one instruction at a time and puts every one
+	// of them in the ring, see trace.h
+	trace_ring* trace = nullptr;
+
+	// Kept up to date with memory while set, see listing.h
+	rom_listing* listing = nullptr;
+
+#if CHIP8_PROFILE
+	chip8_profile profile;
+#endif
+
 
 private:
 	void load_font();
-	void load_instructions();
-	void load_ins_name();
+	void clear_state();
+	instruction& decode_slot(uint32_t slot);
+	void run_traced(uint64_t cycles);
 
 	// Chip-8 instructions
-	void op_00E0();
-	void op_00EE();
-	void op_1nnn();
-	void op_2nnn();
-	void op_3xkk();
-	void op_4xkk();
-	void op_5xy0();
-	void op_6xkk();
-	void op_7xkk();
-	void op_8xy0();
-	void op_8xy1();
-	void op_8xy2();
-	void op_8xy3();
-	void op_8xy4();
-	void op_8xy5();
-	void op_8xy6();
-	void op_8xy7();
-	void op_8xyE();
-	void op_9xy0();
-	void op_Annn();
-	void op_Bnnn();
-	void op_Cxkk();
-	void op_Dxyn();
-	void op_Ex9E();
-	void op_ExA1();
-	void op_Fx07();
-	void op_Fx0A();
-	void op_Fx15();
-	void op_Fx18();
-	void op_Fx1E();
-	void op_Fx29();
-	void op_Fx33();
-	void op_Fx55();
-	void op_Fx65();
+	void op_00E0(const instruction& ins);
+	void op_00EE(const instruction& ins);
+	void op_1nnn(const instruction& ins);
+	void op_2nnn(const instruction& ins);
+	void op_3xkk(const instruction& ins);
+	void op_4xkk(const instruction& ins);
+	void op_5xy0(const instruction& ins);
+	void op_6xkk(const instruction& ins);
+	void op_7xkk(const instruction& ins);
+	void op_8xy0(const instruction& ins);
+	void op_8xy1(const instruction& ins);
+	void op_8xy2(const instruction& ins);
+	void op_8xy3(const instruction& ins);
+	void op_8xy4(const instruction& ins);
+	void op_8xy5(const instruction& ins);
+	void op_8xy6(const instruction& ins);
+	void op_8xy7(const instruction& ins);
+	void op_8xyE(const instruction& ins);
+	void op_9xy0(const instruction& ins);
+	void op_Annn(const instruction& ins);
+	void op_Bnnn(const instruction& ins);
+	void op_Cxkk(const instruction& ins);
+	void op_Dxyn(const instruction& ins);
+	void op_Ex9E(const instruction& ins);
+	void op_ExA1(const instruction& ins);
+	void op_Fx07(const instruction& ins);
+	void op_Fx0A(const instruction& ins);
+	void op_Fx15(const instruction& ins);
+	void op_Fx18(const instruction& ins);
+	void op_Fx1E(const instruction& ins);
+	void op_Fx29(const instruction& ins);
+	void op_Fx33(const instruction& ins);
+	void op_Fx55(const instruction& ins);
+	void op_Fx65(const instruction& ins);
+	void op_invalid(const instruction& ins);
 
 private:
-	instruction_table instructions;
-	std::unordered_map<uint16_t, std::string> ins_names;
+	// indexed by opcode_id, see decode.h
+	static const func handlers[(uint32_t)opcode_id::COUNT];
+
+	// Pre-decoded instruction starting at every address from 0x200 to 0xFFF,
+	// odd ones included since not every program keeps its code aligned
+	instruction decoded[PROGRAM_SIZE]{};
 };
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "chip8.h"
+#include <cstring>
+
+// GCC and Clang can jump through a table of label addresses, every
+// handler then ends with its own copy of the dispatch code which the
+// branch predictor likes a lot more than a single shared switch
+#ifndef CHIP8_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_COMPUTED_GOTO 1
+#else
+#define CHIP8_COMPUTED_GOTO 0
+#endif
+#endif
+
+// Superinstructions get their own labels after the plain instructions
+#define FUSED_LABEL(f) ((uint32_t)opcode_id::COUNT + (uint32_t)(f))
+
+#if CHIP8_PROFILE
+#define PROFILE(address, id, n) profile.count(address, id, n)
+#else
+#define PROFILE(address, id, n) ((void)0)
+#endif
+
+/*
+	Same semantics as calling cycle() `cycles` times, but pc, the registers
+	and I live in locals for the whole batch and every instruction is
+	handled inline instead of through a member function pointer.
+	Sequences marked in instruction::fused run as one superinstruction.
+	Keep in sync with the op_* handlers in chip8.cpp.
+*/
+void chip8::run(uint64_t cycles)
+{
+	if (trace)
+	{
+		run_traced(cycles);
+		return;
+	}
+
+	uint16_t PC = pc;
+	uint16_t I = index;
+	uint8_t V[16];
+	memcpy(V, registers, sizeof(V));
+
+	uint64_t remaining = cycles;
+	instruction uncached{};
+	const instruction* ins = nullptr;
+
+#define FETCH()                                                                         \
+	do                                                                                  \
+	{                                                                                   \
+		if (remaining == 0)                                                             \
+			goto done;                                                                  \
+		remaining--;                                                                    \
+		uint16_t slot = PC - MEMORY_START_ADRESS;                                       \
+		if (slot < PROGRAM_SIZE - 1)                                                    \
+		{                                                                               \
+			ins = &decoded[slot];                                                       \
+			if (!ins->decoded)                                                          \
+				ins = &decode_slot(slot);                                               \
+		}                                                                               \
+		else                                                                            \
+		{                                                                               \
+			uncached = decode_instruction((memory[PC] << 8u) | memory[PC + 1]);         \
+			ins = &uncached;                                                            \
+		}                                                                               \
+		PROFILE(PC, ins->id, 1);                                                        \
+		PC += 2;                                                                        \
+	} while (0)
+
+#define DISPATCH_INDEX() (ins->fused ? FUSED_LABEL(ins->fused) : (uint32_t)ins->id)
+
+#if CHIP8_COMPUTED_GOTO
+	static void* labels[FUSED_LABEL(fusion_id::COUNT)] = {
+		&&L_OP_00E0, &&L_OP_00EE, &&L_OP_1nnn, &&L_OP_2nnn, &&L_OP_3xkk, &&L_OP_4xkk, &&L_OP_5xy0,
+		&&L_OP_6xkk, &&L_OP_7xkk, &&L_OP_8xy0, &&L_OP_8xy1, &&L_OP_8xy2, &&L_OP_8xy3, &&L_OP_8xy4,
+		&&L_OP_8xy5, &&L_OP_8xy6, &&L_OP_8xy7, &&L_OP_8xyE, &&L_OP_9xy0, &&L_OP_Annn, &&L_OP_Bnnn,
+		&&L_OP_Cxkk, &&L_OP_Dxyn, &&L_OP_Ex9E, &&L_OP_ExA1, &&L_OP_Fx07, &&L_OP_Fx0A, &&L_OP_Fx15,
+		&&L_OP_Fx18, &&L_OP_Fx1E, &&L_OP_Fx29, &&L_OP_Fx33, &&L_OP_Fx55, &&L_OP_Fx65,
+		&&L_INVALID,
+		&&F_NONE, &&F_ANNN_DXYN, &&F_SKIP_JP, &&F_DELAY_WAIT, &&F_SPIN
+	};
+
+#define OP(name) L_##name:
+#define FUSED(name) F_##name:
+#define NEXT() do { FETCH(); goto *labels[DISPATCH_INDEX()]; } while (0)
+
+	FETCH();
+	goto *labels[DISPATCH_INDEX()];
+#else
+#define OP(name) case (uint32_t)opcode_id::name:
+#define FUSED(name) case FUSED_LABEL(fusion_id::name):
+#define NEXT() goto next
+
+next:
+	FETCH();
+	switch (DISPATCH_INDEX())
+	{
+#endif
+
+	OP(OP_00E0)
+		clear_display();
+		NEXT();
+
+	OP(OP_00EE)
+		--stack_pointer;
+		PC = stack[stack_pointer & 0xFu];
+		NEXT();
+
+	OP(OP_1nnn)
+		PC = ins->nnn;
+		NEXT();
+
+	OP(OP_2nnn)
+		stack[stack_pointer++ & 0xFu] = PC;
+		PC = ins->nnn;
+		NEXT();
+
+	OP(OP_3xkk)
+		if (V[ins->x] == ins->kk)
+			PC += 2;
+		NEXT();
+
+	OP(OP_4xkk)
+		if (V[ins->x] != ins->kk)
+			PC += 2;
+		NEXT();
+
+	OP(OP_5xy0)
+		if (V[ins->x] == V[ins->y])
+			PC += 2;
+		NEXT();
+
+	OP(OP_6xkk)
+		V[ins->x] = ins->kk;
+		NEXT();
+
+	OP(OP_7xkk)
+		V[ins->x] += ins->kk;
+		NEXT();
+
+	OP(OP_8xy0)
+		V[ins->x] = V[ins->y];
+		NEXT();
+
+	OP(OP_8xy1)
+		V[ins->x] |= V[ins->y];
+		NEXT();
+
+	OP(OP_8xy2)
+		V[ins->x] &= V[ins->y];
+		NEXT();
+
+	OP(OP_8xy3)
+		V[ins->x] ^= V[ins->y];
+		NEXT();
+
+	OP(OP_8xy4)
+	{
+		uint8_t sum = V[ins->x] + V[ins->y];
+		V[VF] = (sum > 255U);
+		V[ins->x] = sum & 0xFFu;
+		NEXT();
+	}
+
+	OP(OP_8xy5)
+		V[VF] = (V[ins->x] > V[ins->y]);
+		V[ins->x] -= V[ins->y];
+		NEXT();
+
+	OP(OP_8xy6)
+		V[VF] = V[ins->x] & 0x1u;
+		V[ins->x] >>= V[ins->x];
+		NEXT();
+
+	OP(OP_8xy7)
+		V[VF] = (V[ins->y] > V[ins->x]);
+		V[ins->x] = V[ins->y] - V[ins->x];
+		NEXT();
+
+	OP(OP_8xyE)
+		V[VF] = (V[ins->x] & 0x80u) >> 7u;
+		V[ins->x] <<= V[ins->x];
+		NEXT();
+
+	OP(OP_9xy0)
+		if (V[ins->x] != V[ins->y])
+			PC += 2;
+		NEXT();
+
+	OP(OP_Annn)
+		I = ins->nnn;
+		NEXT();
+
+	OP(OP_Bnnn)
+		PC = V[0] + ins->nnn;
+		NEXT();
+
+	OP(OP_Cxkk)
+		V[ins->x] = random_byte(random_state) & ins->kk;
+		NEXT();
+
+	OP(OP_Dxyn)
+	draw:
+	{
+		uint8_t x_pos = V[ins->x] % SCREEN_WIDTH;
+		uint8_t y_pos = V[ins->y] % SCREEN_HEIGHT;
+		uint8_t height = ins->n;
+		if (y_pos + height > SCREEN_HEIGHT)
+			height = SCREEN_HEIGHT - y_pos;
+
+		uint8_t collision = 0;
+		uint32_t changed = 0;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			uint64_t sprite_row = (uint64_t)memory[I + y] << 56u >> x_pos;
+			collision |= (display[y_pos + y] & sprite_row) != 0;
+			display[y_pos + y] ^= sprite_row;
+			changed |= uint32_t(sprite_row != 0) << (y_pos + y);
+		}
+		V[VF] = collision;
+
+		if (changed)
+		{
+			dirty_rows |= changed;
+			display_generation++;
+		}
+		NEXT();
+	}
+
+	OP(OP_Ex9E)
+		if (keypad[V[ins->x]])
+			PC += 2;
+		NEXT();
+
+	OP(OP_ExA1)
+		if (!keypad[V[ins->x]])
+			PC += 2;
+		NEXT();
+
+	OP(OP_Fx07)
+		V[ins->x] = delay_timer;
+		NEXT();
+
+	OP(OP_Fx0A)
+	{
+		bool key_pressed = false;
+		for (uint8_t i = 0; i < 16; i++)
+			if (keypad[i])
+			{
+				V[ins->x] = i;
+				key_pressed = true;
+			}
+
+		if (!key_pressed)
+			PC -= 2;
+		NEXT();
+	}
+
+	OP(OP_Fx15)
+		delay_timer = V[ins->x];
+		NEXT();
+
+	OP(OP_Fx18)
+		sound_timer = V[ins->x];
+		NEXT();
+
+	OP(OP_Fx1E)
+		I += V[ins->x];
+		NEXT();
+
+	OP(OP_Fx29)
+		I = FONTSET_START_ADRESS + (5 * V[ins->x]);
+		NEXT();
+
+	OP(OP_Fx33)
+	{
+		uint8_t value = V[ins->x];
+		memory[I + 2] = value % 10;
+		value /= 10;
+		memory[I + 1] = value % 10;
+		value /= 10;
+		memory[I] = value % 10;
+
+		invalidate(I, 3);
+		NEXT();
+	}
+
+	OP(OP_Fx55)
+		for (int i = 0; i <= ins->x; i++)
+			memory[I + i] = V[i];
+		invalidate(I, ins->x + 1);
+		NEXT();
+
+	OP(OP_Fx65)
+		for (int i = 0; i <= ins->x; i++)
+			V[i] = memory[I + i];
+		NEXT();
+
+#if !CHIP8_COMPUTED_GOTO
+	default:
+#endif
+	OP(INVALID)
+		pc = PC;
+		op_invalid(*ins);
+		NEXT();
+
+	// never dispatched, instructions without a fusion use their own label
+	FUSED(NONE)
+		NEXT();
+
+	// x, y and n of the entry belong to the Dxyn
+	FUSED(ANNN_DXYN)
+		I = ins->nnn;
+		if (remaining == 0)
+			goto done;
+		remaining--;
+		PROFILE(PC, opcode_id::OP_Dxyn, 1);
+		PC += 2;
+		fused_instructions += 2;
+		goto draw;
+
+	// nnn of the entry is the target of the 1nnn
+	FUSED(SKIP_JP)
+	{
+		bool skip = (V[ins->x] == ins->kk) == (ins->id == opcode_id::OP_3xkk);
+		if (skip)
+		{
+			PC += 2;
+			NEXT();
+		}
+
+		if (remaining == 0)
+			goto done;
+		remaining--;
+		PROFILE(PC, opcode_id::OP_1nnn, 1);
+		PC = ins->nnn;
+		fused_instructions += 2;
+		NEXT();
+	}
+
+	// Fx07, 3x00, 1nnn polling the delay timer until it runs out. The
+	// timers only tick between batches, so while it isn't 0 every full turn
+	// (the 3x00, the jump and the next Fx07) leaves everything the same
+	// and all of them that fit in the batch are skipped at once
+	FUSED(DELAY_WAIT)
+		V[ins->x] = delay_timer;
+		if (V[ins->x] != 0)
+		{
+			uint64_t turns = remaining / 3;
+			remaining -= turns * 3;
+			fused_instructions += turns * 3;
+			PROFILE(PC - 2, opcode_id::OP_Fx07, turns);
+			PROFILE(PC, opcode_id::OP_3xkk, turns);
+			PROFILE(PC + 2, opcode_id::OP_1nnn, turns);
+		}
+		NEXT();
+
+	// nothing but an interrupt gets out of this loop, so the rest of the
+	// batch is spent in one go
+	FUSED(SPIN)
+		PROFILE(ins->nnn, opcode_id::OP_1nnn, remaining);
+		PC = ins->nnn;
+		fused_instructions += remaining + 1;
+		remaining = 0;
+		NEXT();
+
+#if !CHIP8_COMPUTED_GOTO
+	}
+#endif
+
+done:
+	pc = PC;
+	index = I;
+	memcpy(registers, V, sizeof(V));
+
+#undef FETCH
+#undef DISPATCH_INDEX
+#undef OP
+#undef FUSED
+#undef NEXT
+}
+
+#undef PROFILE
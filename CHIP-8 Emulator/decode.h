@@ -0,0 +1,229 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Every instruction the interpreter knows about, in the same order as
+// the handlers in chip8::handlers and the names in instruction_names
+enum class opcode_id : uint8_t
+{
+	OP_00E0, OP_00EE, OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0,
+	OP_6xkk, OP_7xkk, OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4,
+	OP_8xy5, OP_8xy6, OP_8xy7, OP_8xyE, OP_9xy0, OP_Annn, OP_Bnnn,
+	OP_Cxkk, OP_Dxyn, OP_Ex9E, OP_ExA1, OP_Fx07, OP_Fx0A, OP_Fx15,
+	OP_Fx18, OP_Fx1E, OP_Fx29, OP_Fx33, OP_Fx55, OP_Fx65,
+	INVALID,
+	COUNT
+};
+
+inline constexpr const char* instruction_names[(uint32_t)opcode_id::COUNT] = {
+	"CLS", "RET", "JP addr", "CALL addr", "SE Vx, byte", "SNE Vx, byte", "SE Vx, Vy",
+	"LD Vx, byte", "ADD Vx, byte", "LD Vx, Vy", "OR Vx, Vy", "AND Vx, Vy", "XOR Vx, Vy", "ADD Vx, Vy",
+	"SUB Vx, Vy", "SHR Vx [, Vy]", "SUBN Vx, Vy", "SHL Vx [, Vy]", "SNE Vx, Vy", "LD I, addr", "JP V0, addr",
+	"RND Vx, byte", "DRW Vx, Vy, nibble", "SKP Vx", "SKNP Vx", "LD Vx, DT", "LD Vx, K", "LD DT, Vx",
+	"LD ST, Vx", "ADD I, Vx", "LD F, Vx", "LD B, Vx", "LD [I], Vx", "LD Vx, [I]",
+	""
+};
+
+// The x nibble never takes part in choosing an instruction, so an opcode
+// is identified by its high nibble and its low byte: 16 * 256 entries
+// are enough to cover all 65536 opcodes
+constexpr uint16_t decode_key(uint16_t opcode)
+{
+	return ((opcode & 0xF000u) >> 4u) | (opcode & 0x00FFu);
+}
+
+// The keys the original lookup map had. Ex9E and ExA1 were filed under
+// 0xE00E and 0xE001, which decides what the other Ex opcodes turn into
+constexpr opcode_id decode_known(uint16_t code)
+{
+	switch (code)
+	{
+	case 0x00E0: return opcode_id::OP_00E0;
+	case 0x00EE: return opcode_id::OP_00EE;
+	case 0x1000: return opcode_id::OP_1nnn;
+	case 0x2000: return opcode_id::OP_2nnn;
+	case 0x3000: return opcode_id::OP_3xkk;
+	case 0x4000: return opcode_id::OP_4xkk;
+	case 0x5000: return opcode_id::OP_5xy0;
+	case 0x6000: return opcode_id::OP_6xkk;
+	case 0x7000: return opcode_id::OP_7xkk;
+	case 0x8000: return opcode_id::OP_8xy0;
+	case 0x8001: return opcode_id::OP_8xy1;
+	case 0x8002: return opcode_id::OP_8xy2;
+	case 0x8003: return opcode_id::OP_8xy3;
+	case 0x8004: return opcode_id::OP_8xy4;
+	case 0x8005: return opcode_id::OP_8xy5;
+	case 0x8006: return opcode_id::OP_8xy6;
+	case 0x8007: return opcode_id::OP_8xy7;
+	case 0x800E: return opcode_id::OP_8xyE;
+	case 0x9000: return opcode_id::OP_9xy0;
+	case 0xA000: return opcode_id::OP_Annn;
+	case 0xB000: return opcode_id::OP_Bnnn;
+	case 0xC000: return opcode_id::OP_Cxkk;
+	case 0xD000: return opcode_id::OP_Dxyn;
+	case 0xE00E: return opcode_id::OP_Ex9E;
+	case 0xE001: return opcode_id::OP_ExA1;
+	case 0xF007: return opcode_id::OP_Fx07;
+	case 0xF00A: return opcode_id::OP_Fx0A;
+	case 0xF015: return opcode_id::OP_Fx15;
+	case 0xF018: return opcode_id::OP_Fx18;
+	case 0xF01E: return opcode_id::OP_Fx1E;
+	case 0xF029: return opcode_id::OP_Fx29;
+	case 0xF033: return opcode_id::OP_Fx33;
+	case 0xF055: return opcode_id::OP_Fx55;
+	case 0xF065: return opcode_id::OP_Fx65;
+	}
+	return opcode_id::INVALID;
+}
+
+// Tries the masks in the order the original lookup did, so opcodes that
+// aren't quite right still run as the nearest one: 5xyN and 9xyN as 5xy0
+// and 9xy0, 8xyN with an unknown N as 8xy0, ExNE and ExN1 as Ex9E and
+// ExA1, FxN7 and FxNA as Fx07 and Fx0A, 0xE0 and 0xEE with any x as CLS
+// and RET
+constexpr opcode_id decode_slow(uint16_t opcode)
+{
+	const uint16_t masks[] = { 0xF0FF, 0xF00F, 0xF000 };
+	for (uint16_t mask : masks)
+	{
+		opcode_id id = decode_known(opcode & mask);
+		if (id != opcode_id::INVALID)
+			return id;
+	}
+	return opcode_id::INVALID;
+}
+
+constexpr std::array<opcode_id, 0x1000> build_decode_table()
+{
+	std::array<opcode_id, 0x1000> table{};
+	for (uint32_t key = 0; key < 0x1000; key++)
+		table[key] = decode_slow(uint16_t(((key & 0xF00u) << 4u) | (key & 0x0FFu)));
+	return table;
+}
+
+inline constexpr std::array<opcode_id, 0x1000> decode_table = build_decode_table();
+
+constexpr opcode_id decode(uint16_t opcode)
+{
+	return decode_table[decode_key(opcode)];
+}
+
+// Instruction sequences chip8::run() executes as a single superinstruction
+enum class fusion_id : uint8_t
+{
+	NONE,
+	ANNN_DXYN,      // Annn, Dxyn
+	SKIP_JP,        // 3xkk or 4xkk, 1nnn
+	DELAY_WAIT,     // Fx07, 3x00, 1nnn back to the Fx07
+	SPIN,           // 1nnn jumping to itself
+	COUNT
+};
+
+// A 2-byte instruction with its operands already pulled out of the opcode.
+// Operands the instruction doesn't use may carry the ones of the sequence
+// it was fused with: the Dxyn x, y, n for ANNN_DXYN and the jump target
+// in nnn for SKIP_JP
+struct instruction
+{
+	uint16_t nnn;
+	uint8_t x;
+	uint8_t y;
+	uint8_t n;
+	uint8_t kk;
+	opcode_id id;
+	uint8_t decoded : 1;
+	uint8_t high : 4; // opcode >> 12, with nnn that's the whole opcode back
+	uint8_t fused : 3; // fusion_id
+};
+
+constexpr instruction decode_instruction(uint16_t opcode)
+{
+	instruction ins{};
+	ins.nnn = opcode & 0x0FFFu;
+	// 4 bits from the left of the binary number, shifted right 8 times
+	ins.x = (opcode & 0x0F00u) >> 8u;
+	// 4 bits from the middle of the binary number, shifted right 4 times
+	ins.y = (opcode & 0x00F0u) >> 4u;
+	ins.n = opcode & 0x000Fu;
+	ins.kk = opcode & 0x00FFu;
+	ins.id = decode(opcode);
+	ins.high = opcode >> 12u;
+	ins.decoded = 1;
+	return ins;
+}
+
+// Which superinstruction starts at `address` of a 4K `memory`, if any.
+// The sequences were picked from pair counts over the bundled ROMs, see
+// bench_fusion in the benchmarks
+inline fusion_id find_fusion(const uint8_t* memory, uint16_t address)
+{
+	auto at = [&](uint16_t offset)
+	{
+		uint32_t from = uint32_t(address) + offset;
+		if (from + 1u >= 4096u)
+			return decode_instruction(0x0000);
+		return decode_instruction((memory[from] << 8u) | memory[from + 1]);
+	};
+
+	instruction ins = at(0);
+	switch (ins.id)
+	{
+	case opcode_id::OP_Annn:
+		if (at(2).id == opcode_id::OP_Dxyn)
+			return fusion_id::ANNN_DXYN;
+		break;
+	case opcode_id::OP_3xkk:
+	case opcode_id::OP_4xkk:
+		if (at(2).id == opcode_id::OP_1nnn)
+			return fusion_id::SKIP_JP;
+		break;
+	case opcode_id::OP_Fx07:
+	{
+		instruction check = at(2);
+		instruction jump = at(4);
+		if (check.id == opcode_id::OP_3xkk && check.x == ins.x && check.kk == 0 &&
+			jump.id == opcode_id::OP_1nnn && jump.nnn == address)
+			return fusion_id::DELAY_WAIT;
+		break;
+	}
+	case opcode_id::OP_1nnn:
+		if (ins.nnn == address)
+			return fusion_id::SPIN;
+		break;
+	default:
+		break;
+	}
+	return fusion_id::NONE;
+}
+
+// The instruction at `address` with the operands of `fusion` merged in,
+// `fusion` being what find_fusion says about the same memory
+inline instruction decode_fused(const uint8_t* memory, uint16_t address, fusion_id fusion)
+{
+	instruction ins = decode_instruction((memory[address] << 8u) | memory[(address + 1u) & 0xFFFu]);
+	ins.fused = (uint8_t)fusion;
+
+	if (fusion == fusion_id::ANNN_DXYN)
+	{
+		uint8_t draw = memory[address + 3u];
+		ins.x = memory[address + 2u] & 0x0Fu;
+		ins.y = draw >> 4u;
+		ins.n = draw & 0x0Fu;
+	}
+	else if (fusion == fusion_id::SKIP_JP)
+		ins.nnn = ((memory[address + 2u] & 0x0Fu) << 8u) | memory[address + 3u];
+
+	return ins;
+}
+
+static_assert(sizeof(instruction) == 8);
+static_assert((uint32_t)fusion_id::COUNT <= 8, "instruction::fused is 3 bits");
+static_assert(decode(0x00E0) == opcode_id::OP_00E0);
+static_assert(decode(0x8A5E) == opcode_id::OP_8xyE);
+static_assert(decode(0xE3A1) == opcode_id::OP_ExA1);
+static_assert(decode(0x0123) == opcode_id::INVALID);
+static_assert(decode(0x5AB3) == opcode_id::OP_5xy0);
+static_assert(decode(0x8AB9) == opcode_id::OP_8xy0);
+static_assert(decode(0xE25E) == opcode_id::OP_Ex9E);
+static_assert(decode(0xF137) == opcode_id::OP_Fx07);
+static_assert(decode(0xF0FF) == opcode_id::INVALID);
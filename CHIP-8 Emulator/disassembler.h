@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+#include "decode.h"
+
+// the longest line, "JP V0, 0xFFF", with room to spare and the 0
+#define DISASSEMBLY_LENGTH 16
+
+inline constexpr std::string_view mnemonics[(uint32_t)opcode_id::COUNT] = {
+	"CLS", "RET", "JP", "CALL", "SE", "SNE", "SE",
+	"LD", "ADD", "LD", "OR", "AND", "XOR", "ADD",
+	"SUB", "SHR", "SUBN", "SHL", "SNE", "LD", "JP",
+	"RND", "DRW", "SKP", "SKNP", "LD", "LD", "LD",
+	"LD", "ADD", "LD", "LD", "LD", "LD",
+	"DW"
+};
+
+/*
+	Operands of every instruction, after the mnemonic:
+	%x and %y are the registers, %n the nibble, %k the byte, %a the
+	address and %o the whole opcode (for data that isn't an instruction)
+*/
+inline constexpr std::string_view operands[(uint32_t)opcode_id::COUNT] = {
+	"", "", "%a", "%a", "%x, %k", "%x, %k", "%x, %y",
+	"%x, %k", "%x, %k", "%x, %y", "%x, %y", "%x, %y", "%x, %y", "%x, %y",
+	"%x, %y", "%x, %y", "%x, %y", "%x, %y", "%x, %y", "I, %a", "V0, %a",
+	"%x, %k", "%x, %y, %n", "%x", "%x", "%x, DT", "%x, K", "DT, %x",
+	"ST, %x", "I, %x", "F, %x", "B, %x", "[I], %x", "%x, [I]",
+	"%o"
+};
+
+constexpr std::string_view mnemonic(uint16_t opcode)
+{
+	return mnemonics[(uint32_t)decode(opcode)];
+}
+
+/*
+	Writes "LD V3, 0x1F" and the like into `out`, which has room for
+	DISASSEMBLY_LENGTH characters. Returns the length without the 0.
+	Usable at compile time, nothing gets allocated.
+*/
+constexpr uint32_t disassemble(uint16_t opcode, char* out)
+{
+	constexpr const char* digits = "0123456789ABCDEF";
+	opcode_id id = decode(opcode);
+	uint32_t length = 0;
+
+	auto put_hex = [&](uint32_t value, uint32_t count)
+	{
+		out[length++] = '0';
+		out[length++] = 'x';
+		for (uint32_t i = count; i-- > 0;)
+			out[length++] = digits[(value >> (i * 4u)) & 0xFu];
+	};
+
+	for (char c : mnemonics[(uint32_t)id])
+		out[length++] = c;
+
+	std::string_view pattern = operands[(uint32_t)id];
+	if (!pattern.empty())
+		out[length++] = ' ';
+
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		if (pattern[i] != '%')
+		{
+			out[length++] = pattern[i];
+			continue;
+		}
+
+		switch (pattern[++i])
+		{
+		case 'x': out[length++] = 'V'; out[length++] = digits[(opcode >> 8u) & 0xFu]; break;
+		case 'y': out[length++] = 'V'; out[length++] = digits[(opcode >> 4u) & 0xFu]; break;
+		case 'n': out[length++] = digits[opcode & 0xFu]; break;
+		case 'k': put_hex(opcode & 0xFFu, 2); break;
+		case 'a': put_hex(opcode & 0xFFFu, 3); break;
+		case 'o': put_hex(opcode, 4); break;
+		}
+	}
+
+	out[length] = 0;
+	return length;
+}
+
+namespace disassembler_checks
+{
+	struct line
+	{
+		char text[DISASSEMBLY_LENGTH]{};
+		uint32_t length = 0;
+	};
+
+	constexpr line disassembled(uint16_t opcode)
+	{
+		line result;
+		result.length = disassemble(opcode, result.text);
+		return result;
+	}
+
+	constexpr bool equals(uint16_t opcode, std::string_view expected)
+	{
+		line result = disassembled(opcode);
+		return std::string_view(result.text, result.length) == expected;
+	}
+
+	static_assert(equals(0x00E0, "CLS"));
+	static_assert(equals(0x6A1F, "LD VA, 0x1F"));
+	static_assert(equals(0xD015, "DRW V0, V1, 5"));
+	static_assert(equals(0xBFFF, "JP V0, 0xFFF"));
+	static_assert(equals(0xF355, "LD [I], V3"));
+	static_assert(equals(0x0123, "DW 0x0123"));
+	static_assert(mnemonic(0x8A5E) == "SHL");
+}
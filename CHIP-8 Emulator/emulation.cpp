@@ -0,0 +1,320 @@
+#include "emulation.h"
+
+#include <cstring>
+#include <filesystem>
+
+emulation::emulation()
+{
+	interpreter.listing = &listing;
+	interpreter.initialize();
+	timing.traced_tail = TRACE_SHOWN;
+	listing.build(interpreter.memory);
+}
+
+// commands the worker didn't get to still count, a recording that was
+// asked for gets written even if it never saw an instruction
+emulation::~emulation()
+{
+	stop();
+	apply_commands();
+	finish_recording();
+	dump_profile();
+}
+
+void emulation::start()
+{
+	if (threaded())
+		return;
+
+	quit.store(false);
+	worker = std::thread(&emulation::loop, this);
+}
+
+void emulation::stop()
+{
+	if (!threaded())
+		return;
+
+	quit.store(true);
+	worker.join();
+}
+
+void emulation::load_rom(const std::string& filepath)
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_roms.push_back({ filepath, {} });
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::load_rom(const std::string& name, const uint8_t* data, size_t size, const rom_analysis* analysis)
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_roms.push_back({ name, std::vector<uint8_t>(data, data + size) });
+	if (analysis)
+		pending_roms.back().analysis = *analysis;
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::set_rewind(size_t capacity, uint64_t interval)
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_rewind = true;
+	pending_rewind_capacity = capacity;
+	pending_rewind_interval = interval ? interval : 1;
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::start_recording(const std::string& filepath)
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_recording = filepath;
+	pending_stop_recording = false;
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::stop_recording()
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_recording.clear();
+	pending_stop_recording = true;
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::start_trace(const std::string& filepath)
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_trace = filepath;
+	pending_stop_trace = false;
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::stop_trace()
+{
+	std::lock_guard<std::mutex> lock(commands_lock);
+	pending_trace.clear();
+	pending_stop_trace = true;
+	has_commands.store(true, std::memory_order_release);
+}
+
+void emulation::finish_recording()
+{
+	if (recording.recording())
+		recording.finish(interpreter, timing.executed_instructions(), recording_path);
+	timing.log = nullptr;
+}
+
+void emulation::loop()
+{
+	auto last = std::chrono::steady_clock::now();
+	while (!quit.load(std::memory_order_relaxed))
+	{
+		auto now = std::chrono::steady_clock::now();
+		step(std::chrono::duration<float>(now - last).count());
+		last = now;
+
+		// unlimited keeps the core busy, a fixed rate only needs a
+		// few hundred instructions per millisecond at most
+		if (speed.load(std::memory_order_relaxed) != 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void emulation::step(float dt)
+{
+	apply_commands();
+
+	// from the sound timer as the last step left it, one step late at most
+	bool beeping = interpreter.sound_timer > 0 && !rewinding.load(std::memory_order_relaxed);
+	tone.generate(beeping, dt, audio);
+
+	uint16_t keys = keypad.load(std::memory_order_relaxed);
+	for (uint32_t i = 0; i < 16; i++)
+		interpreter.keypad[i] = (keys >> i) & 1u;
+
+	if (recording.recording() && keys != recorded_keys)
+	{
+		recording.keys(timing.executed_instructions(), keys);
+		recorded_keys = keys;
+	}
+
+	// scrubbing back at the display rate, the scheduler sits still
+	if (rewinding.load(std::memory_order_relaxed))
+	{
+		rewind_time += dt;
+		if (rewind_time < 1.0 / REFRESH_RATE)
+			return;
+		rewind_time -= 1.0 / REFRESH_RATE;
+		if (rewind_time >= 1.0 / REFRESH_RATE)
+			rewind_time = 0.0;
+
+		auto start = std::chrono::steady_clock::now();
+		if (rewind.step_back(interpreter) && recording.recording())
+		{
+			recording.state(timing.executed_instructions(), interpreter);
+			recorded_keys = keypad_bits(interpreter);
+		}
+		rewind_cost += std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+		publish(true);
+		return;
+	}
+
+	timing.instructions_per_second = speed.load(std::memory_order_relaxed);
+	// a stream needs every instruction, the cpu panel only the last few
+	bool streaming = trace.streaming();
+	interpreter.trace = streaming ? &trace : nullptr;
+	timing.tail_trace = !streaming && timing.instructions_per_second ? &trace : nullptr;
+	bool refresh = timing.advance(interpreter, dt);
+
+	if (timing.executed_instructions() - last_record >= rewind_interval)
+	{
+		auto start = std::chrono::steady_clock::now();
+		rewind.record(interpreter);
+		rewind_cost += std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+		last_record = timing.executed_instructions();
+	}
+
+	if (refresh)
+		publish(false);
+}
+
+// the lock is only taken when there is something to do
+void emulation::apply_commands()
+{
+	if (!has_commands.load(std::memory_order_acquire))
+		return;
+
+	std::lock_guard<std::mutex> lock(commands_lock);
+	has_commands.store(false, std::memory_order_relaxed);
+	for (const pending_rom& rom : pending_roms)
+	{
+		dump_profile();
+		rom_path = rom.name;
+		if (rom.data.empty())
+			interpreter.load_rom(rom.name);
+		else
+			interpreter.load_rom(rom.data.data(), rom.data.size());
+		if (rom.analysis)
+			interpreter.predecode(*rom.analysis);
+		timing.reset();
+		rewind.clear();
+		if (recording.recording())
+		{
+			recording.state(timing.executed_instructions(), interpreter);
+			recorded_keys = keypad_bits(interpreter);
+		}
+	}
+	pending_roms.clear();
+
+	if (pending_rewind)
+	{
+		rewind.set_capacity(pending_rewind_capacity);
+		rewind_interval = pending_rewind_interval;
+		pending_rewind = false;
+	}
+
+	if (pending_stop_recording || !pending_recording.empty())
+	{
+		finish_recording();
+		pending_stop_recording = false;
+	}
+
+	if (!pending_recording.empty())
+	{
+		recording_path = pending_recording;
+		recording.start(interpreter, timing.executed_instructions());
+		recorded_keys = keypad_bits(interpreter);
+		timing.log = &recording;
+		pending_recording.clear();
+	}
+
+	if (pending_stop_trace)
+	{
+		trace.stop_streaming();
+		pending_stop_trace = false;
+	}
+
+	if (!pending_trace.empty())
+	{
+		trace.start_streaming(pending_trace);
+		pending_trace.clear();
+	}
+}
+
+uint16_t emulation::opcode_at(uint16_t address) const
+{
+	return (interpreter.memory[address & 0xFFFu] << 8u) | interpreter.memory[(address + 1u) & 0xFFFu];
+}
+
+// From the listing, unless the code at `address` changed since `opcode` ran
+void emulation::copy_line(char* out, uint16_t address, uint16_t opcode) const
+{
+	if (opcode_at(address) != opcode)
+	{
+		disassemble(opcode, out);
+		return;
+	}
+
+	std::string_view line = listing.at(address);
+	memcpy(out, line.data(), line.size());
+	out[line.size()] = 0;
+}
+
+void emulation::publish(bool rewound)
+{
+	emulated_frame& frame = frames.back();
+	memcpy(frame.display, interpreter.display, sizeof(frame.display));
+	frame.display_generation = interpreter.display_generation;
+	frame.previous_generation = published_generation;
+	frame.dirty_rows = interpreter.dirty_rows;
+	interpreter.dirty_rows = 0;
+	published_generation = interpreter.display_generation;
+	memcpy(frame.registers, interpreter.registers, sizeof(frame.registers));
+	frame.pc = interpreter.pc;
+	frame.stack_pointer = interpreter.stack_pointer;
+	frame.trace_count = interpreter.trace || timing.tail_trace ? trace.latest(frame.trace, TRACE_SHOWN) : 0;
+	for (uint32_t i = 0; i < frame.trace_count; i++)
+		copy_line(frame.trace_text[i], frame.trace[i].pc, frame.trace[i].opcode);
+	frame.trace_streaming = trace.streaming();
+	frame.trace_dropped = trace.dropped();
+	frame.executed_instructions = timing.executed_instructions();
+	frame.rewinding = rewound;
+	frame.rewind_states = (uint32_t)rewind.states();
+	frame.rewind_bytes = rewind.bytes();
+	frame.rewind_capacity = rewind.capacity();
+	frame.rewind_microseconds = rewind_cost;
+	rewind_cost = 0.0f;
+	frame.recording_bytes = recording.recording() ? recording.bytes() : 0;
+	frame.audio_queued = audio.queued();
+	frame.audio_underruns = audio.underruns();
+	frame.audio_overruns = audio.overruns();
+
+#if CHIP8_PROFILE
+	std::vector<hot_address> hot = interpreter.profile.hottest(PROFILE_HOT_ADDRESSES);
+	for (uint32_t i = 0; i < PROFILE_HOT_ADDRESSES; i++)
+	{
+		frame.hot[i] = i < hot.size() ? hot[i] : hot_address{ 0, 0 };
+		copy_line(frame.hot_text[i], frame.hot[i].address, opcode_at(frame.hot[i].address));
+	}
+	frame.profiled_instructions = interpreter.profile.total;
+#endif
+	frame.published = std::chrono::steady_clock::now();
+	frames.publish();
+}
+
+// profiles/<rom>.csv by address, <rom>-opcodes.csv by opcode class and
+// <rom>.folded for flamegraph.pl, then starts counting from 0
+void emulation::dump_profile()
+{
+#if CHIP8_PROFILE
+	if (rom_path.empty() || interpreter.profile.total == 0)
+		return;
+
+	std::filesystem::create_directories("profiles");
+	std::string name = std::filesystem::path(rom_path).stem().string();
+	std::string path = "profiles/" + name;
+	interpreter.profile.write_csv(path + ".csv", interpreter.memory);
+	interpreter.profile.write_opcode_csv(path + "-opcodes.csv");
+	interpreter.profile.write_folded(path + ".folded", name, interpreter.memory);
+	interpreter.profile.clear();
+#endif
+}
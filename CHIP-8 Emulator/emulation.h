@@ -0,0 +1,200 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analysis.h"
+#include "audio.h"
+#include "chip8.h"
+#include "input_log.h"
+#include "listing.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "triple_buffer.h"
+
+// instructions listed in the cpu panel
+#define TRACE_SHOWN 4
+
+// rows of the profiler panel
+#define PROFILE_HOT_ADDRESSES 3
+
+// Everything the UI needs to draw a frame, copied out of the interpreter
+struct emulated_frame
+{
+	uint64_t display[SCREEN_HEIGHT];
+	// chip8::display_generation now and when the frame before was
+	// published, and the rows that changed in between
+	uint32_t display_generation;
+	uint32_t previous_generation;
+	uint32_t dirty_rows;
+
+	uint8_t registers[16];
+	uint16_t pc;
+	uint8_t stack_pointer;
+
+	// the last instructions that ran, oldest first. None at unlimited
+	// speed unless a trace is being streamed. Their cycle counts the
+	// records in the ring, not executed instructions, those only match
+	// while streaming
+	trace_record trace[TRACE_SHOWN];
+	char trace_text[TRACE_SHOWN][DISASSEMBLY_LENGTH];
+	uint32_t trace_count;
+	bool trace_streaming;
+	uint64_t trace_dropped;
+
+	uint64_t executed_instructions;
+	std::chrono::steady_clock::time_point published;
+
+	// rewind ring use and the time spent recording or rewinding since
+	// the frame before
+	bool rewinding;
+	uint32_t rewind_states;
+	size_t rewind_bytes;
+	size_t rewind_capacity;
+	float rewind_microseconds;
+
+	// size of the input log so far, 0 when not recording
+	size_t recording_bytes;
+
+	// samples waiting for the audio device and how often it went without
+	uint32_t audio_queued;
+	uint64_t audio_underruns;
+	uint64_t audio_overruns;
+
+#if CHIP8_PROFILE
+	// most executed addresses of the current rom, count 0 past the last one
+	hot_address hot[PROFILE_HOT_ADDRESSES];
+	char hot_text[PROFILE_HOT_ADDRESSES][DISASSEMBLY_LENGTH];
+	uint64_t profiled_instructions;
+#endif
+};
+
+#define REWIND_CAPACITY (16 * 1024 * 1024)
+
+// about once per frame at the default 700 ips
+#define REWIND_INTERVAL 12
+
+/*
+	Owns the interpreter and its scheduler. Either runs them on a thread of
+	its own (start/stop) or gets stepped by the caller (step), both go
+	through the same code so the two modes behave the same.
+	Frames come out through a triple buffer, the keypad goes in as an
+	atomic bitmask and everything else (roms, speed) through commands.
+	Every REWIND_INTERVAL instructions the state goes into a rewind ring,
+	while rewinding is held one record comes back per display refresh.
+	Profiling builds write the counts of a rom to profiles/ when another
+	one gets loaded and when the emulation goes away.
+	Only a trace being streamed to a file sees every instruction, since
+	tracing turns off the superinstructions. Otherwise, at a fixed speed,
+	the scheduler traces the last TRACE_SHOWN instructions of every
+	advance for the cpu panel, and nothing at unlimited speed.
+	Every step also puts the beeper's samples for its dt into `audio`,
+	for the audio callback to take out.
+*/
+struct emulation
+{
+public:
+	emulation();
+	~emulation();
+
+	emulation(const emulation&) = delete;
+	emulation& operator=(const emulation&) = delete;
+
+	void start();
+	void stop();
+	bool threaded() { return worker.joinable(); }
+
+	// Runs dt seconds worth of emulation on the calling thread,
+	// only while not threaded
+	void step(float dt);
+
+	// bit n is key n
+	void set_keys(uint16_t keys) { keypad.store(keys, std::memory_order_relaxed); }
+	void set_speed(uint32_t instructions_per_second) { speed.store(instructions_per_second, std::memory_order_relaxed); }
+	void load_rom(const std::string& filepath);
+	// Takes a copy of a rom that is already in memory, `name` is what
+	// the profiler calls it. With an analysis of the rom its code gets
+	// decoded up front (chip8::predecode)
+	void load_rom(const std::string& name, const uint8_t* data, size_t size, const rom_analysis* analysis = nullptr);
+
+	void set_rewinding(bool held) { rewinding.store(held, std::memory_order_relaxed); }
+
+	// Empties the rewind ring, it then records every `interval` instructions
+	// in at most `capacity` bytes
+	void set_rewind(size_t capacity, uint64_t interval);
+
+	// Logs the input from here on, the file gets written when recording
+	// stops or the emulation goes away. See input_log.h
+	void start_recording(const std::string& filepath);
+	void stop_recording();
+
+	// Streams every instruction to `filepath` from a background thread,
+	// see trace.h
+	void start_trace(const std::string& filepath);
+	void stop_trace();
+
+	// read by the UI thread only
+	triple_buffer<emulated_frame> frames;
+
+	// read by the audio callback only
+	audio_ring audio;
+
+private:
+	chip8 interpreter;
+	scheduler timing;
+
+	std::atomic<uint16_t> keypad{ 0 };
+	std::atomic<uint32_t> speed{ 700 };
+	std::atomic<bool> quit{ false };
+	std::atomic<bool> rewinding{ false };
+
+	rewind_ring rewind{ REWIND_CAPACITY };
+	uint64_t rewind_interval = REWIND_INTERVAL;
+	uint64_t last_record = 0;
+	double rewind_time = 0.0;
+	float rewind_cost = 0.0f;
+	uint32_t published_generation = 0;
+
+	std::string rom_path;
+	trace_ring trace;
+	rom_listing listing;
+	beeper tone;
+
+	input_log recording;
+	std::string recording_path;
+	uint16_t recorded_keys = 0;
+
+	std::mutex commands_lock;
+	// no data means the name is a path
+	struct pending_rom
+	{
+		std::string name;
+		std::vector<uint8_t> data;
+		std::optional<rom_analysis> analysis;
+	};
+	std::vector<pending_rom> pending_roms;
+	bool pending_rewind = false;
+	std::string pending_recording;
+	bool pending_stop_recording = false;
+	std::string pending_trace;
+	bool pending_stop_trace = false;
+	size_t pending_rewind_capacity = 0;
+	uint64_t pending_rewind_interval = 0;
+	std::atomic<bool> has_commands{ false };
+
+	std::thread worker;
+
+	void loop();
+	void apply_commands();
+	void publish(bool rewound);
+	void finish_recording();
+	void dump_profile();
+	uint16_t opcode_at(uint16_t address) const;
+	void copy_line(char* out, uint16_t address, uint16_t opcode) const;
+};
@@ -1,9 +1,36 @@
-﻿#include <windows.h>
+﻿/*
+	Windows gets a real window, everything else (or FM_HEADLESS) gets the
+	headless backend: an offscreen buffer that never shows up anywhere,
+	optional PPM dumps of it and key presses read from a script
+*/
+#if !defined(_WIN32) && !defined(FM_HEADLESS)
+#define FM_HEADLESS
+#endif
+
+#ifndef FM_HEADLESS
+#include <windows.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
 #include <iostream>
 #include <chrono>
 #include <cmath>
 #include <unordered_map>
 #include <fstream>
+#include <list>
+#include <algorithm>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+#include "blit.h"
 
 #undef max
 #undef min
@@ -20,6 +47,7 @@ namespace fm
 		UP, DOWN, LEFT, RIGHT,
 		F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12,
 		MINUS, PLUS, LEFT_BRACKET /* [ */, RIGHT_BRACKET /* ] */,
+		BACKSPACE,
 		COUNT
 	};
 
@@ -129,6 +157,8 @@ namespace fm
 		}
 
 		void set_buffer(void* buf);
+		// copies only `count` rows starting at `first`, buf is still the whole image
+		void set_rows(void* buf, uint32_t first, uint32_t count);
 
 	private:
 		uint32_t width;
@@ -145,6 +175,30 @@ namespace fm
 		uint32_t height;
 	};
 
+	/*
+		Font atlas, 1 bit per texel:
+			4       magic "FMFA"
+			2       version
+			1       height of every glyph in rows
+			1       reserved, 0
+			2       number of glyphs
+			2       number of rows
+			        4 bytes per glyph:
+			1           character
+			1           width in texels, 8 at most
+			2           first row
+			        rows, one byte each with the leftmost texel in bit 0
+		Glyphs can share rows, upper and lower case letters do.
+		batch-runner --font makes one out of the .spr textures.
+	*/
+#define FM_FONT_FILE "font.fnt"
+#define FM_FONT_MAGIC 0x41464D46u // "FMFA"
+#define FM_FONT_VERSION 1
+
+// samples per waveOut buffer, 2.9 ms at 44100
+#define FM_AUDIO_BLOCK 128
+#define FM_AUDIO_BLOCKS 2
+
 	struct Button
 	{
 		bool pressed = false;
@@ -154,7 +208,9 @@ namespace fm
 
 	struct application
 	{
+#ifndef FM_HEADLESS
 		friend LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+#endif
 	public:
 		application() = default;
 		virtual ~application()
@@ -195,9 +251,11 @@ namespace fm
 	private:
 		struct window
 		{
+#ifndef FM_HEADLESS
 			HWND handle;
 			WNDCLASS window_class;
 			HDC device_context;
+#endif
 
 			uint32_t width;
 			uint32_t height;
@@ -210,7 +268,9 @@ namespace fm
 		struct grahics_context
 		{
 			uint32_t* memory_buffer;
+#ifndef FM_HEADLESS
 			BITMAPINFO bm_info;
+#endif
 			uint32_t buffer_size;
 
 			uint32_t pixel_size;
@@ -221,6 +281,9 @@ namespace fm
 
 		void core_update();
 
+		// made from resizable, minimize_button and maximize_button
+		unsigned long window_flags();
+
 		/*
 			initialize *pwindow
 			flags can be modified by changing resizable, minimize_button and maximize_button values
@@ -245,21 +308,83 @@ namespace fm
 		*/
 		void free_memory();
 
+#ifdef FM_HEADLESS
+		/*
+			set from the environment when the window gets created
+			FM_FRAMES      stops after this many frames, runs forever when 0 or unset
+			FM_DUMP_EVERY  writes every n-th frame as FM_DUMP_DIR/frame_<n>.ppm
+			FM_DUMP_DIR    where the dumps go, the working directory by default
+			FM_INPUT       key script, one "<frame> <key> <down|up>" per line
+			FM_DT          fixed dt in seconds for on_update instead of real time
+			FM_AUDIO       wave file for the samples of open_audio
+		*/
+		struct scripted_key
+		{
+			uint64_t frame;
+			uint32_t key;
+			bool state;
+		};
+
+		uint64_t frame = 0;
+		uint64_t max_frames = 0;
+		uint64_t dump_every = 0;
+		std::string dump_dir = ".";
+		float fixed_dt = 0.0f;
+		std::vector<scripted_key> script;
+		size_t next_scripted_key = 0;
+
+		void load_script(const std::string& filepath);
+		void apply_script();
+		void dump_frame();
+#endif
+
 		std::unordered_map<std::string, texture*> textures;
 
-		enum class font_type
+		// the font, from the atlas load_font reads. glyph_rows[offset + i]
+		// is row i of a glyph with the leftmost texel in bit 0
+		struct glyph
+		{
+			uint16_t offset;
+			uint8_t width;
+			bool exists;
+		};
+		glyph glyphs[256]{};
+		std::vector<uint8_t> glyph_rows;
+		uint32_t font_glyph_height = 0;
+
+		std::function<void(int16_t*, uint32_t)> audio_fill;
+		uint32_t audio_rate = 0;
+#ifndef FM_HEADLESS
+		HWAVEOUT audio_device = nullptr;
+		HANDLE audio_event = nullptr;
+		WAVEHDR audio_headers[FM_AUDIO_BLOCKS]{};
+		int16_t audio_buffers[FM_AUDIO_BLOCKS][FM_AUDIO_BLOCK]{};
+		std::thread audio_thread;
+		std::atomic<bool> audio_running{ false };
+#else
+		FILE* audio_file = nullptr;
+		uint32_t audio_bytes = 0;
+		double audio_pending = 0.0;
+		std::vector<int16_t> audio_samples;
+		void pull_audio(float dt);
+#endif
+
+		// text already turned into horizontal runs of lit pixels, relative to
+		// where it gets drawn. Most recently used first, the oldest one goes
+		// when there are more than text_run_capacity
+		struct text_span
+		{
+			uint32_t x, y, length;
+		};
+		struct text_run
 		{
-			CHARACTERS,
-			NUMBERS,
-			SYMBOLS
+			std::string key;
+			std::vector<text_span> spans;
 		};
-		texture* font[3];
-		std::unordered_map<char, uint32_t> glyph_width;
-		uint32_t get_glyph_width(char c);
-		uint32_t get_symbol_offet(char sym);
-		bool glyph_exist(char c);
-		const uint32_t font_glyph_width = 6;
-		const uint32_t font_glyph_height = 7;
+		std::list<text_run> text_runs;
+		std::unordered_map<std::string, std::list<text_run>::iterator> text_run_lookup;
+		const uint32_t text_run_capacity = 128;
+		const text_run& get_text_run(const std::string& text, uint32_t s);
 
 		Button keyboard_state[Key::COUNT];
 		bool keyboard_new_state[Key::COUNT]{ false };
@@ -278,23 +403,40 @@ namespace fm
 		void draw_quad(const fm::color& c, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t t = 1u);
 		// s refers to pixel size not actual size
 		void draw_framebuffer(framebuffer* fm, uint32_t x, uint32_t y, uint32_t s = 1);
+		// redraws only rows [first_row, first_row + row_count) of the framebuffer
+		void draw_framebuffer(framebuffer* fm, uint32_t x, uint32_t y, uint32_t s, uint32_t first_row, uint32_t row_count);
 
 		void draw_text(const std::string& text, uint32_t x, uint32_t y,
 			uint32_t s, fm::color c);
 
 		texture* load_texture(const std::string& filepath);
 
-		// only one font available for this framework
+		// only one font available for this framework, read from
+		// FM_FONT_FILE in the given folder
 		void load_font(const std::string& filepath);
 		uint32_t get_text_width(const std::string& text, uint32_t size = 1);
+
+		/*
+			Asks `fill` for `rate` mono 16 bit samples a second. On windows
+			they go to waveOut and `fill` runs on a thread of its own, with
+			FM_AUDIO_BLOCKS blocks of FM_AUDIO_BLOCK samples queued ahead.
+			Headless, `fill` gets called after every on_update for dt worth
+			of samples, which get written to the FM_AUDIO wave file if set.
+		*/
+		bool open_audio(uint32_t rate, std::function<void(int16_t* samples, uint32_t count)> fill);
+
+		// before anything `fill` uses goes away
+		void close_audio();
 	};
 
 #ifdef fm_def
 #undef fm_def
 
-	static std::unordered_map<uint32_t, uint32_t> VK_keys_map;
 	application* application::app_instance;
 
+#ifndef FM_HEADLESS
+	static std::unordered_map<uint32_t, uint32_t> VK_keys_map;
+
 	static void load_vk_keys()
 	{
 		/*
@@ -304,6 +446,7 @@ namespace fm
 		UP, DOWN, LEFT, RIGHT,
 		F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12,
 		MINUS, PLUS, LEFT_BRACKET, RIGHT_BRACKET,
+		BACKSPACE,
 			COUNT
 		*/
 		for (uint32_t i = 'A'; i <= 'Z'; i++)
@@ -323,18 +466,18 @@ namespace fm
 
 		VK_keys_map[VK_OEM_MINUS] = Key::MINUS; VK_keys_map[VK_OEM_PLUS] = Key::PLUS;
 		VK_keys_map[VK_OEM_4] = Key::LEFT_BRACKET; VK_keys_map[VK_OEM_6] = Key::RIGHT_BRACKET;
+		VK_keys_map[VK_BACK] = Key::BACKSPACE;
 	}
+#else
+	// keys come from the FM_INPUT script by name, see key_names
+	static void load_vk_keys() {}
+#endif
 
 	bool application::initialize(const wchar_t* name, uint32_t w, uint32_t h, uint32_t p)
 	{
 		app_instance = this;
 
-		int flags = WS_OVERLAPPEDWINDOW;
-		if (!resizable) flags ^= WS_THICKFRAME;
-		if (!minimize_button) flags ^= WS_MINIMIZEBOX;
-		if (!maximize_button) flags ^= WS_MAXIMIZEBOX;
-
-		if (!create_window(name, w, h, flags))
+		if (!create_window(name, w, h, window_flags()))
 			return false;
 
 		if (!create_graphics_context(w / p, h / p, p))
@@ -348,12 +491,7 @@ namespace fm
 	{
 		app_instance = this;
 
-		int flags = WS_OVERLAPPEDWINDOW;
-		if (!resizable) flags ^= WS_THICKFRAME;
-		if (!minimize_button) flags ^= WS_MINIMIZEBOX;
-		if (!maximize_button) flags ^= WS_MAXIMIZEBOX;
-
-		if (!create_window(name, w, h, flags))
+		if (!create_window(name, w, h, window_flags()))
 			return false;
 
 		if (!create_graphics_context(buffer_w, buffer_h, w / buffer_w))
@@ -398,9 +536,16 @@ namespace fm
 			now = std::chrono::system_clock::now();
 			dt = std::chrono::duration<float>(now - old).count();
 			old = now;
+#ifdef FM_HEADLESS
+			if (fixed_dt > 0.0f)
+				dt = fixed_dt;
+#endif
 
 			core_update();
 			on_update(dt);
+#ifdef FM_HEADLESS
+			pull_audio(dt);
+#endif
 
 			present();
 			poll_events();
@@ -480,68 +625,93 @@ namespace fm
 
 	void application::draw_framebuffer(framebuffer* fm, uint32_t x, uint32_t y, uint32_t s)
 	{
-		uint32_t pos_y = y + fm->height * s;
+		draw_framebuffer(fm, x, y, s, 0, fm->height);
+	}
 
-		for (uint32_t i = 0; i < fm->height; i++)
-		{
-			uint32_t pos_x = x;
-			for (uint32_t j = 0; j < fm->width; j++)
-			{
-				draw_quad_fill(fm::color(fm->buffer[i * fm->width + j]),
-					pos_x, pos_y, s, s);
-				pos_x += s;
-			}
-			pos_y -= s;
-		}
+	void application::draw_framebuffer(framebuffer* fm, uint32_t x, uint32_t y, uint32_t s, uint32_t first_row, uint32_t row_count)
+	{
+		blit_scaled(pgraphics_context->memory_buffer, pgraphics_context->buffer_width, pgraphics_context->buffer_height,
+			fm->buffer, fm->width, fm->height, x, y, s, first_row, row_count);
 	}
 
 	void application::draw_text(const std::string& text, uint32_t x, uint32_t y,
 		uint32_t s, fm::color col)
 	{
-		for (uint32_t ch = 0; ch < text.size(); ch++)
+		uint32_t* buffer = pgraphics_context->memory_buffer;
+		uint32_t width = pgraphics_context->buffer_width;
+		uint32_t height = pgraphics_context->buffer_height;
+
+		for (const text_span& span : get_text_run(text, s).spans)
 		{
-			char c = text[ch];
-			if (c == ' ')
-			{
-				x += 5;
+			uint32_t pos_x = x + span.x;
+			uint32_t pos_y = y + span.y;
+			if (pos_x >= width || pos_y >= height)
 				continue;
-			}
 
-			// daca e litera mare nu gaseste bine offsetul
-			if (std::isupper(c))
-				c = std::tolower(c);
+			uint32_t length = min(span.length, width - pos_x);
+			std::fill_n(buffer + pos_y * width + pos_x, length, col.hex);
+		}
+	}
 
-			font_type type;
-			uint32_t offset;
+	// the spans don't depend on the colour, so it stays out of the key and the
+	// same string in two colours shares one entry
+	const application::text_run& application::get_text_run(const std::string& text, uint32_t s)
+	{
+		std::string key = text;
+		key.push_back('\0');
+		key.append((const char*)&s, sizeof(s));
 
-			if (std::isalpha(c))
-				type = font_type::CHARACTERS, offset = c - 'a';
-			else if (std::isdigit(c))
-				type = font_type::NUMBERS, offset = c - '0';
-			else if (glyph_exist(c))
-				type = font_type::SYMBOLS, offset = get_symbol_offet(c);
-			else abort();
+		auto found = text_run_lookup.find(key);
+		if (found != text_run_lookup.end())
+		{
+			text_runs.splice(text_runs.begin(), text_runs, found->second);
+			return *found->second;
+		}
 
-			uint32_t pos_x = x;
-			uint32_t pos_y = y;
+		text_run run;
+		run.key = key;
 
-			int width = get_glyph_width(c);
+		uint32_t pen = 0;
+		for (char c : text)
+		{
+			if (c == ' ')
+			{
+				pen += 5;
+				continue;
+			}
+
+			const glyph& g = glyphs[(uint8_t)c];
+			if (!g.exists)
+				abort();
 
 			for (uint32_t i = 0; i < font_glyph_height; i++)
 			{
-				pos_x = x;
-
-				for (uint32_t j = offset * font_glyph_width + 1;
-					j < offset * font_glyph_width + width + 1; j++)
+				uint8_t bits = glyph_rows[g.offset + i];
+				for (uint32_t j = 0; j < g.width; j++)
 				{
-					if (!(font[(uint32_t)type]->buffer[i * font[(uint32_t)type]->width + j] == -1))
-						draw_quad_fill(col, pos_x, pos_y, s, s);
-					pos_x += s;
+					if (!(bits & (1u << j)))
+						continue;
+
+					uint32_t first = j;
+					while (j < g.width && (bits & (1u << j)))
+						j++;
+
+					for (uint32_t r = 0; r < s; r++)
+						run.spans.push_back({ pen + first * s, i * s + r, (j - first) * s });
 				}
-				pos_y += s;
 			}
-			x = pos_x + 1;
+			pen += g.width * s + 1;
+		}
+
+		if (text_runs.size() >= text_run_capacity)
+		{
+			text_run_lookup.erase(text_runs.back().key);
+			text_runs.pop_back();
 		}
+
+		text_runs.push_front(std::move(run));
+		text_run_lookup[key] = text_runs.begin();
+		return text_runs.front();
 	}
 
 	texture* application::load_texture(const std::string& filepath)
@@ -549,24 +719,20 @@ namespace fm
 		if (textures.find(filepath) != textures.end())
 			return textures[filepath];
 
-		texture* tex = new texture();
-
-		std::ifstream readFile(filepath.c_str(), std::ios::in | std::ios::binary);
-		std::string extension = std::string(filepath.begin() + filepath.find_last_of(".") + 1, filepath.end());
-
-		if (!readFile.good())
+		// the texels are 32 bit ARGB on disk too, they go straight into the buffer
+		FILE* file = fopen(filepath.c_str(), "rb");
+		if (!file)
 			abort();
 
-		readFile.read((char*)&tex->width, sizeof(uint32_t));
-		readFile.read((char*)&tex->height, sizeof(uint32_t));
+		texture* tex = new texture();
+		if (fread(&tex->width, sizeof(uint32_t), 1, file) != 1 || fread(&tex->height, sizeof(uint32_t), 1, file) != 1)
+			abort();
 
-		tex->buffer = new uint32_t[tex->width * tex->height];
-		long temp = 0;
-		for (uint32_t i = 0; i < tex->width * tex->height; i++)
-		{
-			readFile.read((char*)&temp, sizeof(uint32_t));
-			tex->buffer[i] = temp;
-		}
+		size_t texels = (size_t)tex->width * tex->height;
+		tex->buffer = new uint32_t[texels];
+		if (fread(tex->buffer, sizeof(uint32_t), texels, file) != texels)
+			abort();
+		fclose(file);
 
 		textures.insert(std::make_pair(filepath, tex));
 		return tex;
@@ -575,37 +741,55 @@ namespace fm
 	// Location of the "font" folder
 	void application::load_font(const std::string& filepath)
 	{
-		font[(uint32_t)font_type::CHARACTERS] = load_texture(filepath + "characters.spr");
-		font[(uint32_t)font_type::NUMBERS] = load_texture(filepath + "numbers.spr");
-		font[(uint32_t)font_type::SYMBOLS] = load_texture(filepath + "symbols.spr");
-
-		// each character spacing
-		glyph_width['a'] = font_glyph_width - 2; glyph_width['b'] = font_glyph_width - 2;
-		glyph_width['c'] = font_glyph_width - 2; glyph_width['d'] = font_glyph_width - 2;
-		glyph_width['e'] = font_glyph_width - 2; glyph_width['f'] = font_glyph_width - 2;
-		glyph_width['g'] = font_glyph_width - 2; glyph_width['h'] = font_glyph_width - 2;
-		glyph_width['i'] = font_glyph_width - 5; glyph_width['j'] = font_glyph_width - 2;
-		glyph_width['k'] = font_glyph_width - 2; glyph_width['l'] = font_glyph_width - 2;
-		glyph_width['m'] = font_glyph_width - 1; glyph_width['n'] = font_glyph_width - 2;
-		glyph_width['o'] = font_glyph_width - 2; glyph_width['p'] = font_glyph_width - 2;
-		glyph_width['q'] = font_glyph_width - 2; glyph_width['r'] = font_glyph_width - 2;
-		glyph_width['s'] = font_glyph_width - 2; glyph_width['t'] = font_glyph_width - 1;
-		glyph_width['u'] = font_glyph_width - 2; glyph_width['v'] = font_glyph_width - 1;
-		glyph_width['w'] = font_glyph_width - 1; glyph_width['x'] = font_glyph_width - 3;
-		glyph_width['y'] = font_glyph_width - 2; glyph_width['z'] = font_glyph_width - 2;
-		glyph_width['0'] = font_glyph_width - 2; glyph_width['1'] = font_glyph_width - 4;
-		glyph_width['2'] = font_glyph_width - 2; glyph_width['3'] = font_glyph_width - 2;
-		glyph_width['4'] = font_glyph_width - 2; glyph_width['5'] = font_glyph_width - 2;
-		glyph_width['6'] = font_glyph_width - 2; glyph_width['7'] = font_glyph_width - 2;
-		glyph_width['8'] = font_glyph_width - 2; glyph_width['9'] = font_glyph_width - 2;
-		glyph_width['!'] = font_glyph_width - 5; glyph_width['?'] = font_glyph_width - 2;
-		glyph_width[':'] = font_glyph_width - 5; glyph_width[';'] = font_glyph_width - 4;
-		glyph_width['.'] = font_glyph_width - 5; glyph_width[','] = font_glyph_width - 4;
-		glyph_width['['] = font_glyph_width - 4; glyph_width[']'] = font_glyph_width - 4;
-		glyph_width['='] = font_glyph_width - 2; glyph_width['*'] = font_glyph_width - 5;
-		glyph_width['/'] = font_glyph_width - 1; glyph_width['-'] = font_glyph_width - 2;
-		glyph_width['+'] = font_glyph_width - 1; glyph_width['<'] = font_glyph_width - 1;
-		glyph_width['>'] = font_glyph_width - 1; glyph_width['\\'] = font_glyph_width - 4;
+		std::string path = filepath + FM_FONT_FILE;
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			std::cout << "can't open " << path << ", batch-runner --font makes it\n";
+			abort();
+		}
+
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		std::vector<uint8_t> atlas(size > 0 ? (size_t)size : 0);
+		size_t read = fread(atlas.data(), 1, atlas.size(), file);
+		fclose(file);
+
+		uint32_t magic = 0;
+		uint16_t version = 0, glyph_count = 0, row_count = 0;
+		if (read == atlas.size() && atlas.size() >= 12)
+		{
+			memcpy(&magic, &atlas[0], 4);
+			memcpy(&version, &atlas[4], 2);
+			memcpy(&glyph_count, &atlas[8], 2);
+			memcpy(&row_count, &atlas[10], 2);
+		}
+
+		size_t rows_start = 12 + (size_t)glyph_count * 4;
+		if (magic != FM_FONT_MAGIC || version != FM_FONT_VERSION || rows_start + row_count > atlas.size())
+		{
+			std::cout << path << " isn't a font atlas\n";
+			abort();
+		}
+
+		font_glyph_height = atlas[6];
+		glyph_rows.assign(atlas.begin() + rows_start, atlas.begin() + rows_start + row_count);
+		for (glyph& g : glyphs)
+			g = glyph{};
+
+		for (uint32_t i = 0; i < glyph_count; i++)
+		{
+			const uint8_t* entry = &atlas[12 + i * 4];
+			uint16_t offset;
+			memcpy(&offset, entry + 2, 2);
+			if (entry[1] > 8 || offset + font_glyph_height > row_count)
+				continue;
+			glyphs[entry[0]] = { offset, entry[1], true };
+		}
+
+		text_runs.clear();
+		text_run_lookup.clear();
 	}
 
 	uint32_t application::get_text_width(const std::string& text, uint32_t s)
@@ -618,7 +802,7 @@ namespace fm
 		for (uint32_t i = 0; i < text.size(); i++)
 		{
 			if (text[i] != ' ')
-				size += get_glyph_width(text[i]) * s;
+				size += glyphs[(uint8_t)text[i]].width * s;
 			else size += 5;
 		}
 
@@ -627,52 +811,19 @@ namespace fm
 		return size;
 	}
 
-	uint32_t application::get_glyph_width(char c)
+	Button application::get_key(Key name)
 	{
-		if (!(c >= -1 && c <= 255))
-			return 0;
-
-		if (std::isupper(c))
-			c = tolower(c);
-
-		if (glyph_width.find(c) == glyph_width.end())
-			return 0;
-
-		return glyph_width[c];
-	}
-
-	// can t use the ascii code to get the offset directly
-	uint32_t application::get_symbol_offet(char sym)
-	{
-		int n = 0;
-		switch (sym)
-		{
-		case '!':  n = 0;  break;
-		case '?':  n = 1;  break;
-		case ':':  n = 2;  break;
-		case ';':  n = 3;  break;
-		case '.':  n = 4;  break;
-		case ',':  n = 5;  break;
-		case '[':  n = 6;  break;
-		case ']':  n = 7;  break;
-		case '=':  n = 8;  break;
-		case '*':  n = 9;  break;
-		case '/':  n = 10;  break;
-		case '-':  n = 11;  break;
-		case '+':  n = 12;  break;
-		case '<':  n = 13;  break;
-		case '>':  n = 14;  break;
-		case '\\': n = 15;  break;
-		}
-
-		return n;
+		return keyboard_state[name];
 	}
 
-	bool application::glyph_exist(char c)
+#ifndef FM_HEADLESS
+	unsigned long application::window_flags()
 	{
-		if (glyph_width.find(c) == glyph_width.end())
-			return false;
-		return true;
+		unsigned long flags = WS_OVERLAPPEDWINDOW;
+		if (!resizable) flags ^= WS_THICKFRAME;
+		if (!minimize_button) flags ^= WS_MINIMIZEBOX;
+		if (!maximize_button) flags ^= WS_MAXIMIZEBOX;
+		return flags;
 	}
 
 	v2<float> application::mouse_position()
@@ -691,11 +842,6 @@ namespace fm
 		return mouse_pos;
 	}
 
-	Button application::get_key(Key name)
-	{
-		return keyboard_state[name];
-	}
-
 	static LRESULT CALLBACK window_proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	{
 		switch (msg)
@@ -793,10 +939,340 @@ namespace fm
 		SetWindowText(pwindow->handle, title.c_str());
 	}
 
+	bool application::open_audio(uint32_t rate, std::function<void(int16_t*, uint32_t)> fill)
+	{
+		close_audio();
+
+		WAVEFORMATEX format{};
+		format.wFormatTag = WAVE_FORMAT_PCM;
+		format.nChannels = 1;
+		format.nSamplesPerSec = rate;
+		format.wBitsPerSample = 16;
+		format.nBlockAlign = 2;
+		format.nAvgBytesPerSec = rate * 2;
+
+		audio_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (!audio_event || waveOutOpen(&audio_device, WAVE_MAPPER, &format, (DWORD_PTR)audio_event, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR)
+		{
+			if (audio_event)
+				CloseHandle(audio_event);
+			audio_event = nullptr;
+			audio_device = nullptr;
+			return false;
+		}
+
+		// whoever fills the samples most likely sleeps a millisecond at a
+		// time, which windows rounds up to 15 unless asked
+		timeBeginPeriod(1);
+
+		audio_fill = fill;
+		audio_rate = rate;
+		audio_running = true;
+
+		// silence first, `fill` takes over as the blocks come back
+		for (uint32_t i = 0; i < FM_AUDIO_BLOCKS; i++)
+		{
+			WAVEHDR& header = audio_headers[i];
+			header = WAVEHDR{};
+			header.lpData = (LPSTR)audio_buffers[i];
+			header.dwBufferLength = sizeof(audio_buffers[i]);
+			memset(audio_buffers[i], 0, sizeof(audio_buffers[i]));
+			waveOutPrepareHeader(audio_device, &header, sizeof(header));
+			waveOutWrite(audio_device, &header, sizeof(header));
+		}
+
+		// waveOut can't be called from its own callback, the event wakes
+		// this thread instead every time a block is done playing
+		audio_thread = std::thread([this]
+		{
+			while (audio_running.load())
+			{
+				WaitForSingleObject(audio_event, 50);
+				for (WAVEHDR& header : audio_headers)
+				{
+					if (!(header.dwFlags & WHDR_DONE) || !audio_running.load())
+						continue;
+					audio_fill((int16_t*)header.lpData, FM_AUDIO_BLOCK);
+					waveOutWrite(audio_device, &header, sizeof(header));
+				}
+			}
+		});
+		return true;
+	}
+
+	void application::close_audio()
+	{
+		if (!audio_device)
+			return;
+
+		audio_running = false;
+		SetEvent(audio_event);
+		audio_thread.join();
+
+		waveOutReset(audio_device);
+		for (WAVEHDR& header : audio_headers)
+			waveOutUnprepareHeader(audio_device, &header, sizeof(header));
+		waveOutClose(audio_device);
+		CloseHandle(audio_event);
+		timeEndPeriod(1);
+
+		audio_device = nullptr;
+		audio_event = nullptr;
+		audio_fill = nullptr;
+	}
+
+	void application::free_memory()
+	{
+		close_audio();
+
+		// an application that never got initialized can still have textures
+		if (pgraphics_context)
+			VirtualFree(pgraphics_context->memory_buffer, 0, MEM_FREE);
+		if (pwindow)
+			DestroyWindow(pwindow->handle);
+
+		delete pwindow;
+		delete pgraphics_context;
+
+		for (auto& tex : textures)
+			delete tex.second;
+	}
+
+#else
+	// same order as Key
+	static const char* key_names[Key::COUNT] = {
+		"A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N", "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z",
+		"SPACE", "ENTER", "CTRL", "ALT", "TAB", "SHIFT",
+		"0", "1", "2", "3", "4", "5", "6", "7", "8", "9",
+		"UP", "DOWN", "LEFT", "RIGHT",
+		"F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10", "F11", "F12",
+		"MINUS", "PLUS", "[", "]",
+		"BACKSPACE"
+	};
+
+	static uint64_t env_number(const char* name)
+	{
+		const char* value = getenv(name);
+		return value ? strtoull(value, nullptr, 10) : 0;
+	}
+
+	unsigned long application::window_flags()
+	{
+		return 0;
+	}
+
+	// there is no mouse either
+	v2<float> application::mouse_position()
+	{
+		return { 0.0f, 0.0f };
+	}
+
+	bool application::create_window(const std::wstring& name, uint16_t w, uint16_t h, unsigned long flags)
+	{
+		pwindow = new window();
+		pwindow->width = w;
+		pwindow->height = h;
+		pwindow->info_string = "";
+		pwindow->name = name;
+
+		max_frames = env_number("FM_FRAMES");
+		dump_every = env_number("FM_DUMP_EVERY");
+		if (const char* dir = getenv("FM_DUMP_DIR"))
+			dump_dir = dir;
+		if (const char* dt = getenv("FM_DT"))
+			fixed_dt = (float)atof(dt);
+		if (const char* input = getenv("FM_INPUT"))
+			load_script(input);
+
+		// keys scripted for frame 0 are held from the start
+		apply_script();
+		return true;
+	}
+
+	void application::load_script(const std::string& filepath)
+	{
+		std::ifstream file(filepath);
+		if (!file.good())
+		{
+			std::cout << "can't open input script " << filepath << "\n";
+			return;
+		}
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			uint64_t key_frame;
+			char name[16];
+			char state[8];
+			if (sscanf(line.c_str(), "%llu %15s %7s", (unsigned long long*)&key_frame, name, state) != 3)
+				continue;
+
+			for (uint32_t key = 0; key < Key::COUNT; key++)
+				if (strcmp(key_names[key], name) == 0)
+					script.push_back({ key_frame, key, strcmp(state, "down") == 0 });
+		}
+
+		std::stable_sort(script.begin(), script.end(),
+			[](const scripted_key& a, const scripted_key& b) { return a.frame < b.frame; });
+	}
+
+	void application::apply_script()
+	{
+		while (next_scripted_key < script.size() && script[next_scripted_key].frame <= frame)
+		{
+			update_key_state(script[next_scripted_key].key, script[next_scripted_key].state);
+			next_scripted_key++;
+		}
+	}
+
+	void application::poll_events()
+	{
+		frame++;
+		if (max_frames && frame >= max_frames)
+			is_running = false;
+
+		apply_script();
+	}
+
+	bool application::create_graphics_context(uint32_t w, uint32_t h, uint32_t p)
+	{
+		if (!pwindow)
+			return false;
+
+		pgraphics_context = new grahics_context();
+
+		pgraphics_context->buffer_width = w;
+		pgraphics_context->buffer_height = h;
+		pgraphics_context->pixel_size = p;
+		pgraphics_context->buffer_size = w * h;
+		pgraphics_context->memory_buffer = new uint32_t[w * h]{};
+
+		return true;
+	}
+
+	void application::present()
+	{
+		if (dump_every && frame % dump_every == 0)
+			dump_frame();
+	}
+
+	// binary PPM, the buffer is bottom-up like the windows bitmap
+	void application::dump_frame()
+	{
+		std::filesystem::create_directories(dump_dir);
+		std::string path = dump_dir + "/frame_" + std::to_string(frame) + ".ppm";
+
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return;
+
+		uint32_t w = pgraphics_context->buffer_width;
+		uint32_t h = pgraphics_context->buffer_height;
+		fprintf(file, "P6\n%u %u\n255\n", w, h);
+
+		std::vector<uint8_t> row(w * 3);
+		for (uint32_t y = h; y-- > 0;)
+		{
+			const uint32_t* pixel = pgraphics_context->memory_buffer + y * w;
+			for (uint32_t x = 0; x < w; x++)
+			{
+				row[x * 3 + 0] = (pixel[x] >> 16) & 0xFF;
+				row[x * 3 + 1] = (pixel[x] >> 8) & 0xFF;
+				row[x * 3 + 2] = pixel[x] & 0xFF;
+			}
+			fwrite(row.data(), 1, row.size(), file);
+		}
+		fclose(file);
+	}
+
+	void application::add_title_info(const std::wstring& info)
+	{
+	}
+
+	// 44 byte header of a 16 bit mono wave file
+	static void write_wav_header(FILE* file, uint32_t rate, uint32_t data_bytes)
+	{
+		uint32_t riff_bytes = 36 + data_bytes, format_bytes = 16, byte_rate = rate * 2;
+		uint16_t pcm = 1, channels = 1, block_align = 2, bits = 16;
+		fwrite("RIFF", 1, 4, file);
+		fwrite(&riff_bytes, 4, 1, file);
+		fwrite("WAVEfmt ", 1, 8, file);
+		fwrite(&format_bytes, 4, 1, file);
+		fwrite(&pcm, 2, 1, file);
+		fwrite(&channels, 2, 1, file);
+		fwrite(&rate, 4, 1, file);
+		fwrite(&byte_rate, 4, 1, file);
+		fwrite(&block_align, 2, 1, file);
+		fwrite(&bits, 2, 1, file);
+		fwrite("data", 1, 4, file);
+		fwrite(&data_bytes, 4, 1, file);
+	}
+
+	bool application::open_audio(uint32_t rate, std::function<void(int16_t*, uint32_t)> fill)
+	{
+		close_audio();
+
+		audio_fill = fill;
+		audio_rate = rate;
+		audio_pending = 0.0;
+		audio_bytes = 0;
+
+		if (const char* path = getenv("FM_AUDIO"))
+		{
+			audio_file = fopen(path, "wb");
+			if (!audio_file)
+			{
+				std::cout << "can't write " << path << "\n";
+				return false;
+			}
+			write_wav_header(audio_file, rate, 0);
+		}
+		return true;
+	}
+
+	// the samples of one frame, taken as if a device played them in real time
+	void application::pull_audio(float dt)
+	{
+		if (!audio_fill)
+			return;
+
+		audio_pending += (double)dt * audio_rate;
+		uint32_t count = (uint32_t)audio_pending;
+		audio_pending -= count;
+		if (!count)
+			return;
+
+		audio_samples.resize(count);
+		audio_fill(audio_samples.data(), count);
+		if (audio_file)
+		{
+			fwrite(audio_samples.data(), sizeof(int16_t), count, audio_file);
+			audio_bytes += count * sizeof(int16_t);
+		}
+	}
+
+	void application::close_audio()
+	{
+		audio_fill = nullptr;
+		if (!audio_file)
+			return;
+
+		// the sizes are only known now
+		fseek(audio_file, 0, SEEK_SET);
+		write_wav_header(audio_file, audio_rate, audio_bytes);
+		fclose(audio_file);
+		audio_file = nullptr;
+	}
+
 	void application::free_memory()
 	{
-		VirtualFree(pgraphics_context->memory_buffer, 0, MEM_FREE);
-		DestroyWindow(pwindow->handle);
+		close_audio();
+
+		if (pgraphics_context)
+			delete[] pgraphics_context->memory_buffer;
 
 		delete pwindow;
 		delete pgraphics_context;
@@ -804,11 +1280,17 @@ namespace fm
 		for (auto& tex : textures)
 			delete tex.second;
 	}
+#endif
 
 	void framebuffer::set_buffer(void* buf)
 	{
 		memcpy(buffer, buf, width * height * sizeof(uint32_t));
 	}
 
+	void framebuffer::set_rows(void* buf, uint32_t first, uint32_t count)
+	{
+		memcpy(buffer + first * width, (uint32_t*)buf + first * width, count * width * sizeof(uint32_t));
+	}
+
 #endif
 }
\ No newline at end of file
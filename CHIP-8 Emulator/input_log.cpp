@@ -0,0 +1,221 @@
+#include "input_log.h"
+#include "savestate.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+uint16_t keypad_bits(const chip8& interpreter)
+{
+	uint16_t keys = 0;
+	for (uint32_t i = 0; i < 16; i++)
+		keys |= (interpreter.keypad[i] ? 1u : 0u) << i;
+	return keys;
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(uint8_t(value) | 0x80u);
+		value >>= 7u;
+	}
+	out.push_back(uint8_t(value));
+}
+
+static bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (uint32_t shift = 0; in < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *in++;
+		value |= uint64_t(byte & 0x7Fu) << shift;
+		if (!(byte & 0x80u))
+			return true;
+	}
+	return false;
+}
+
+static void put_state(std::vector<uint8_t>& out, const chip8& interpreter)
+{
+	size_t at = out.size();
+	out.resize(at + STATE_SIZE);
+	interpreter.save_state(out.data() + at);
+}
+
+void input_log::start(const chip8& interpreter, uint64_t cycle)
+{
+	active = true;
+	first_cycle = cycle;
+	last_cycle = cycle;
+	initial.clear();
+	events.clear();
+	put_state(initial, interpreter);
+}
+
+void input_log::event(uint64_t cycle, input_event kind)
+{
+	put_varint(events, ((cycle - last_cycle) << 2u) | kind);
+	last_cycle = cycle;
+}
+
+void input_log::keys(uint64_t cycle, uint16_t keys)
+{
+	if (!active)
+		return;
+	event(cycle, EVENT_KEYS);
+	events.push_back(uint8_t(keys));
+	events.push_back(uint8_t(keys >> 8u));
+}
+
+void input_log::tick(uint64_t cycle)
+{
+	if (active)
+		event(cycle, EVENT_TICK);
+}
+
+void input_log::state(uint64_t cycle, const chip8& interpreter)
+{
+	if (!active)
+		return;
+	event(cycle, EVENT_STATE);
+	put_state(events, interpreter);
+}
+
+bool input_log::finish(const chip8& interpreter, uint64_t cycle, const std::string& filepath)
+{
+	if (!active)
+		return false;
+	active = false;
+
+	FILE* file = fopen(filepath.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	uint32_t magic = INPUT_LOG_MAGIC;
+	uint16_t version = INPUT_LOG_VERSION;
+	uint16_t reserved = 0;
+	uint64_t length = events.size();
+	uint64_t total = cycle - first_cycle;
+	uint64_t hash = interpreter.display_hash();
+
+	fwrite(&magic, 4, 1, file);
+	fwrite(&version, 2, 1, file);
+	fwrite(&reserved, 2, 1, file);
+	fwrite(initial.data(), 1, initial.size(), file);
+	fwrite(&length, 8, 1, file);
+	fwrite(events.data(), 1, events.size(), file);
+	fwrite(&total, 8, 1, file);
+	bool written = fwrite(&hash, 8, 1, file) == 1;
+	fclose(file);
+	return written;
+}
+
+// Size of the save state at `in`, from its header
+static size_t state_size(const uint8_t* in, const uint8_t* end)
+{
+	uint32_t payload;
+	if (end - in < STATE_HEADER_SIZE)
+		return 0;
+	memcpy(&payload, in + 8, 4);
+	if (payload > size_t(end - in) - STATE_HEADER_SIZE)
+		return 0;
+	return STATE_HEADER_SIZE + payload;
+}
+
+replay_result replay_input_log(const std::string& filepath)
+{
+	replay_result result;
+
+	FILE* file = fopen(filepath.c_str(), "rb");
+	if (file == NULL)
+		return result;
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	std::vector<uint8_t> data(length > 0 ? length : 0);
+	size_t read = fread(data.data(), 1, data.size(), file);
+	fclose(file);
+	if (read != data.size() || data.size() < 8)
+		return result;
+
+	const uint8_t* in = data.data();
+	const uint8_t* end = in + data.size();
+
+	uint32_t magic;
+	uint16_t version;
+	memcpy(&magic, in, 4);
+	memcpy(&version, in + 4, 2);
+	in += 8;
+	if (magic != INPUT_LOG_MAGIC || version != INPUT_LOG_VERSION)
+		return result;
+
+	std::unique_ptr<chip8> interpreter = std::make_unique<chip8>();
+	interpreter->initialize();
+	size_t size = state_size(in, end);
+	if (!size || !interpreter->load_state(in, size))
+		return result;
+	in += size;
+
+	uint64_t events_length;
+	if (end - in < 8)
+		return result;
+	memcpy(&events_length, in, 8);
+	in += 8;
+	if (events_length > uint64_t(end - in) || uint64_t(end - in) - events_length != 16)
+		return result;
+
+	const uint8_t* events_end = in + events_length;
+	memcpy(&result.cycles, events_end, 8);
+	memcpy(&result.expected_hash, events_end + 8, 8);
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t executed = 0;
+	while (in < events_end)
+	{
+		uint64_t value;
+		if (!get_varint(in, events_end, value))
+			return result;
+
+		uint64_t delta = value >> 2u;
+		interpreter->run(delta);
+		executed += delta;
+
+		switch (value & 3u)
+		{
+		case EVENT_TICK:
+			interpreter->tick_timers();
+			break;
+		case EVENT_KEYS:
+		{
+			if (events_end - in < 2)
+				return result;
+			uint16_t keys = in[0] | (in[1] << 8u);
+			for (uint32_t i = 0; i < 16; i++)
+				interpreter->keypad[i] = (keys >> i) & 1u;
+			in += 2;
+			break;
+		}
+		case EVENT_STATE:
+			size = state_size(in, events_end);
+			if (!size || !interpreter->load_state(in, size))
+				return result;
+			in += size;
+			break;
+		default:
+			return result;
+		}
+		result.events++;
+	}
+
+	if (executed > result.cycles)
+		return result;
+	interpreter->run(result.cycles - executed);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	result.loaded = true;
+	result.hash = interpreter->display_hash();
+	result.matched = result.hash == result.expected_hash;
+	return result;
+}
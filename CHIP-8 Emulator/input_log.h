@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+	Everything from outside that a run depends on, so it can be played back
+	bit for bit: the state it started from (save_state, which carries the
+	Cxkk generator), then every keypad change and timer tick stamped with
+	the instruction count it happened at. Loading a rom or rewinding puts a
+	whole state in the log.
+
+	File layout:
+		4       magic "C8IL"
+		2       version
+		2       reserved, 0
+		        starting state, as written by chip8::save_state
+		8       length of the events
+		        events: LEB128 varint of (instructions since the last
+		        event << 2 | kind), followed by 2 key bytes for EVENT_KEYS
+		        and a whole state for EVENT_STATE
+		8       instructions in the whole run
+		8       chip8::display_hash() at the end
+*/
+#define INPUT_LOG_MAGIC 0x4C493843u // "C8IL"
+#define INPUT_LOG_VERSION 1
+
+enum input_event : uint8_t
+{
+	EVENT_TICK,
+	EVENT_KEYS,
+	EVENT_STATE
+};
+
+struct input_log
+{
+public:
+	// `cycle` is the instruction count of whoever drives the interpreter,
+	// the log only keeps differences
+	void start(const chip8& interpreter, uint64_t cycle);
+	void keys(uint64_t cycle, uint16_t keys);
+	void tick(uint64_t cycle);
+	void state(uint64_t cycle, const chip8& interpreter);
+
+	// Writes the log and stops recording
+	bool finish(const chip8& interpreter, uint64_t cycle, const std::string& filepath);
+
+	bool recording() const { return active; }
+	size_t bytes() const { return initial.size() + events.size(); }
+
+private:
+	bool active = false;
+	uint64_t first_cycle = 0;
+	uint64_t last_cycle = 0;
+	std::vector<uint8_t> initial;
+	std::vector<uint8_t> events;
+
+	void event(uint64_t cycle, input_event kind);
+};
+
+// keypad as a bitmask, bit n is key n
+uint16_t keypad_bits(const chip8& interpreter);
+
+struct replay_result
+{
+	bool loaded = false;
+	bool matched = false;
+	uint64_t cycles = 0;
+	uint64_t events = 0;
+	uint64_t expected_hash = 0;
+	uint64_t hash = 0;
+	double seconds = 0.0;
+};
+
+// Runs a log as fast as the interpreter goes and checks the display
+// ends up the way it did when it was recorded
+replay_result replay_input_log(const std::string& filepath);
@@ -0,0 +1,456 @@
+#include "jit.h"
+#include <cstring>
+
+#if CHIP8_JIT_AVAILABLE
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#define JIT_BUFFER_SIZE (1024 * 1024)
+#define JIT_MAX_BLOCK_LENGTH 64
+// worst case for a single instruction is well below this
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_LENGTH * 96)
+
+#if CHIP8_JIT_AVAILABLE
+
+// rbx always holds the chip8 pointer and r12 the remaining cycle budget,
+// both are callee saved so helper calls leave them alone
+namespace
+{
+	struct emitter
+	{
+		uint8_t* p;
+
+		void u8(uint8_t v) { *p++ = v; }
+		void u16(uint16_t v) { memcpy(p, &v, 2); p += 2; }
+		void u32(uint32_t v) { memcpy(p, &v, 4); p += 4; }
+		void u64(uint64_t v) { memcpy(p, &v, 8); p += 8; }
+
+		// op [rbx + disp32] with the reg field of the ModRM byte set to r
+		void mem(uint8_t r, uint32_t disp) { u8(0x80 | (r << 3) | 3); u32(disp); }
+
+		void mov_mem8_imm(uint32_t d, uint8_t v) { u8(0xC6); mem(0, d); u8(v); }
+		void add_mem8_imm(uint32_t d, uint8_t v) { u8(0x80); mem(0, d); u8(v); }
+		void cmp_mem8_imm(uint32_t d, uint8_t v) { u8(0x80); mem(7, d); u8(v); }
+		void mov_mem16_imm(uint32_t d, uint16_t v) { u8(0x66); u8(0xC7); mem(0, d); u16(v); }
+		void mov_al_mem(uint32_t d) { u8(0x8A); mem(0, d); }
+		void mov_mem_al(uint32_t d) { u8(0x88); mem(0, d); }
+		void mov_mem_ax(uint32_t d) { u8(0x66); u8(0x89); mem(0, d); }
+		void movzx_eax_mem8(uint32_t d) { u8(0x0F); u8(0xB6); mem(0, d); }
+		void add_mem16_ax(uint32_t d) { u8(0x66); u8(0x01); mem(0, d); }
+		void or_mem_al(uint32_t d) { u8(0x08); mem(0, d); }
+		void and_mem_al(uint32_t d) { u8(0x20); mem(0, d); }
+		void xor_mem_al(uint32_t d) { u8(0x30); mem(0, d); }
+		void cmp_mem_al(uint32_t d) { u8(0x38); mem(0, d); }
+
+		// lea eax, [rax + rax * 4 + v]
+		void lea_eax_5x_plus(uint8_t v) { u8(0x8D); u8(0x44); u8(0x80); u8(v); }
+
+		// returns the address of the rel32 so it can be patched later
+		uint8_t* jmp32(uint8_t* target)
+		{
+			u8(0xE9);
+			uint8_t* site = p;
+			u32(uint32_t(target - (site + 4)));
+			return site;
+		}
+
+		uint8_t* jcc8(uint8_t cc) { u8(0x70 | cc); u8(0); return p - 1; }
+		void bind8(uint8_t* site) { *site = uint8_t(p - (site + 1)); }
+
+		// helper(rbx, arg) following the platform calling convention
+		void call_helper(void* helper, uint32_t arg)
+		{
+#ifdef _WIN32
+			u8(0x48); u8(0x89); u8(0xD9);   // mov rcx, rbx
+			u8(0xBA); u32(arg);             // mov edx, arg
+#else
+			u8(0x48); u8(0x89); u8(0xDF);   // mov rdi, rbx
+			u8(0xBE); u32(arg);             // mov esi, arg
+#endif
+			u8(0x48); u8(0xB8); u64((uint64_t)helper); // mov rax, helper
+			u8(0xFF); u8(0xD0);             // call rax
+		}
+	};
+
+	enum condition : uint8_t { CC_E = 0x4, CC_NE = 0x5 };
+
+	void execute_helper(chip8* cpu, uint32_t opcode)
+	{
+		cpu->execute_instuction(uint16_t(opcode));
+	}
+}
+
+static uint32_t offset_of(chip8& cpu, void* member)
+{
+	return uint32_t((uint8_t*)member - (uint8_t*)&cpu);
+}
+
+chip8_jit::chip8_jit(chip8& interpreter) : cpu(interpreter)
+{
+#ifdef _WIN32
+	code = (uint8_t*)VirtualAlloc(0, JIT_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* p = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	code = p == MAP_FAILED ? nullptr : (uint8_t*)p;
+#endif
+	if (code)
+	{
+		code_size = JIT_BUFFER_SIZE;
+		emit_stubs();
+	}
+
+	cpu.jit = this;
+	flush();
+}
+
+chip8_jit::~chip8_jit()
+{
+	if (cpu.jit == this)
+		cpu.jit = nullptr;
+
+	if (!code)
+		return;
+#ifdef _WIN32
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, code_size);
+#endif
+}
+
+void chip8_jit::emit_stubs()
+{
+	emitter e{ code };
+
+	entry = (entry_func)e.p;
+	e.u8(0x53);                             // push rbx
+	e.u8(0x41); e.u8(0x54);                 // push r12
+	e.u8(0x48); e.u8(0x83); e.u8(0xEC); e.u8(40); // sub rsp, 40 (shadow space + alignment)
+#ifdef _WIN32
+	e.u8(0x48); e.u8(0x89); e.u8(0xCB);     // mov rbx, rcx
+	e.u8(0x49); e.u8(0x89); e.u8(0xD4);     // mov r12, rdx
+	e.u8(0x41); e.u8(0xFF); e.u8(0xE0);     // jmp r8
+#else
+	e.u8(0x48); e.u8(0x89); e.u8(0xFB);     // mov rbx, rdi
+	e.u8(0x49); e.u8(0x89); e.u8(0xF4);     // mov r12, rsi
+	e.u8(0xFF); e.u8(0xE2);                 // jmp rdx
+#endif
+
+	exit_stub = e.p;
+	e.u8(0x4C); e.u8(0x89); e.u8(0xE0);     // mov rax, r12
+	e.u8(0x48); e.u8(0x83); e.u8(0xC4); e.u8(40); // add rsp, 40
+	e.u8(0x41); e.u8(0x5C);                 // pop r12
+	e.u8(0x5B);                             // pop rbx
+	e.u8(0xC3);                             // ret
+
+	stubs_size = uint32_t(e.p - code);
+}
+
+// Only resets the bookkeeping, the code of the block that is running
+// when a helper triggers this stays intact until the next compile
+void chip8_jit::flush()
+{
+	memset(blocks, 0, sizeof(blocks));
+	memset(block_length, 0, sizeof(block_length));
+	memset(translated, 0, sizeof(translated));
+	pending_links.clear();
+	block_count = 0;
+	code_used = stubs_size;
+}
+
+void chip8_jit::invalidate(uint16_t address, uint16_t length)
+{
+	// a write into translated code throws everything away, self modifying
+	// code is rare enough that tracking links per block isn't worth it
+	for (uint32_t i = address; i < uint32_t(address) + length && i < sizeof(translated); i++)
+		if (translated[i])
+		{
+			flush();
+			return;
+		}
+}
+
+void chip8_jit::link_to(uint8_t* site, uint16_t target)
+{
+	uint16_t slot = target - MEMORY_START_ADRESS;
+	if (slot >= PROGRAM_SIZE - 1)
+		return; // never translated, stays an exit to the dispatcher
+
+	if (blocks[slot])
+	{
+		uint8_t* dest = blocks[slot];
+		uint32_t rel = uint32_t(dest - (site + 4));
+		memcpy(site, &rel, 4);
+	}
+	else
+		pending_links.push_back({ site, target });
+}
+
+uint8_t* chip8_jit::compile(uint16_t address)
+{
+	if (code_size - code_used < JIT_MAX_BLOCK_BYTES)
+		flush();
+
+	const uint32_t R = offset_of(cpu, cpu.registers);
+	const uint32_t PC = offset_of(cpu, &cpu.pc);
+	const uint32_t I = offset_of(cpu, &cpu.index);
+	const uint32_t DT = offset_of(cpu, &cpu.delay_timer);
+	const uint32_t ST = offset_of(cpu, &cpu.sound_timer);
+
+	uint8_t* start = code + code_used;
+	emitter e{ start };
+
+	// budget check, the block only runs if it can run to the end
+	e.u8(0x49); e.u8(0x81); e.u8(0xFC);
+	uint8_t* length_imm = e.p;
+	e.u32(0);                               // cmp r12, length
+	uint8_t* enough = e.jcc8(0x3);          // jae
+	e.mov_mem16_imm(PC, address);
+	e.jmp32(exit_stub);
+	e.bind8(enough);
+	e.u8(0x49); e.u8(0x81); e.u8(0xEC);
+	uint8_t* length_imm2 = e.p;
+	e.u32(0);                               // sub r12, length
+
+	uint16_t pc = address;
+	uint32_t length = 0;
+	bool ended = false;
+
+	std::vector<link> links;
+	auto exit_to = [&](uint16_t target)
+	{
+		e.mov_mem16_imm(PC, target);
+		links.push_back({ e.jmp32(exit_stub), target });
+	};
+	auto exit_to_dispatcher = [&]()
+	{
+		e.jmp32(exit_stub);
+	};
+
+	while (!ended && length < JIT_MAX_BLOCK_LENGTH && pc + 1u < sizeof(cpu.memory))
+	{
+		uint16_t opcode = (cpu.memory[pc] << 8u) | cpu.memory[pc + 1];
+		instruction ins = decode_instruction(opcode);
+		uint16_t next = pc + 2;
+
+		// left to the interpreter, it reads the opcode back from memory
+		if (ins.id == opcode_id::INVALID)
+			break;
+
+		length++;
+		switch (ins.id)
+		{
+		case opcode_id::OP_6xkk:
+			e.mov_mem8_imm(R + ins.x, ins.kk);
+			break;
+		case opcode_id::OP_7xkk:
+			e.add_mem8_imm(R + ins.x, ins.kk);
+			break;
+		case opcode_id::OP_8xy0:
+			e.mov_al_mem(R + ins.y);
+			e.mov_mem_al(R + ins.x);
+			break;
+		case opcode_id::OP_8xy1:
+			e.mov_al_mem(R + ins.y);
+			e.or_mem_al(R + ins.x);
+			break;
+		case opcode_id::OP_8xy2:
+			e.mov_al_mem(R + ins.y);
+			e.and_mem_al(R + ins.x);
+			break;
+		case opcode_id::OP_8xy3:
+			e.mov_al_mem(R + ins.y);
+			e.xor_mem_al(R + ins.x);
+			break;
+		case opcode_id::OP_Annn:
+			e.mov_mem16_imm(I, ins.nnn);
+			break;
+		case opcode_id::OP_Fx07:
+			e.mov_al_mem(DT);
+			e.mov_mem_al(R + ins.x);
+			break;
+		case opcode_id::OP_Fx15:
+			e.mov_al_mem(R + ins.x);
+			e.mov_mem_al(DT);
+			break;
+		case opcode_id::OP_Fx18:
+			e.mov_al_mem(R + ins.x);
+			e.mov_mem_al(ST);
+			break;
+		case opcode_id::OP_Fx1E:
+			e.movzx_eax_mem8(R + ins.x);
+			e.add_mem16_ax(I);
+			break;
+		case opcode_id::OP_Fx29:
+			e.movzx_eax_mem8(R + ins.x);
+			e.lea_eax_5x_plus(FONTSET_START_ADRESS);
+			e.mov_mem_ax(I);
+			break;
+
+		// no control flow and no memory writes, so they can stay inside the block
+		case opcode_id::OP_00E0:
+		case opcode_id::OP_8xy4:
+		case opcode_id::OP_8xy5:
+		case opcode_id::OP_8xy6:
+		case opcode_id::OP_8xy7:
+		case opcode_id::OP_8xyE:
+		case opcode_id::OP_Cxkk:
+		case opcode_id::OP_Dxyn:
+		case opcode_id::OP_Fx65:
+			e.call_helper((void*)execute_helper, opcode);
+			break;
+
+		case opcode_id::OP_1nnn:
+			exit_to(ins.nnn);
+			ended = true;
+			break;
+		case opcode_id::OP_2nnn:
+			e.mov_mem16_imm(PC, next);
+			e.call_helper((void*)execute_helper, opcode);
+			exit_to(ins.nnn);
+			ended = true;
+			break;
+
+		case opcode_id::OP_3xkk:
+		case opcode_id::OP_4xkk:
+		case opcode_id::OP_5xy0:
+		case opcode_id::OP_9xy0:
+		{
+			uint8_t skip_when;
+			if (ins.id == opcode_id::OP_3xkk || ins.id == opcode_id::OP_4xkk)
+				e.cmp_mem8_imm(R + ins.x, ins.kk);
+			else
+			{
+				e.mov_al_mem(R + ins.y);
+				e.cmp_mem_al(R + ins.x);
+			}
+			skip_when = (ins.id == opcode_id::OP_3xkk || ins.id == opcode_id::OP_5xy0) ? CC_E : CC_NE;
+
+			// jump over the skipping exit when the condition doesn't hold
+			uint8_t* no_skip = e.jcc8(skip_when ^ 1u);
+			exit_to(next + 2);
+			e.bind8(no_skip);
+			exit_to(next);
+			ended = true;
+			break;
+		}
+
+		// the rest decide where to go at run time or may write into
+		// translated code, so they always return to the dispatcher
+		default:
+			e.mov_mem16_imm(PC, next);
+			e.call_helper((void*)execute_helper, opcode);
+			exit_to_dispatcher();
+			ended = true;
+			break;
+		}
+
+		for (uint16_t b = pc; b < next; b++)
+			translated[b] = true;
+		pc = next;
+	}
+
+	if (length == 0)
+		return nullptr;
+
+	if (!ended)
+		exit_to(pc);
+
+	memcpy(length_imm, &length, 4);
+	memcpy(length_imm2, &length, 4);
+	code_used = uint32_t(e.p - code);
+
+	uint16_t slot = address - MEMORY_START_ADRESS;
+	blocks[slot] = start;
+	block_length[slot] = uint8_t(length);
+	block_count++;
+
+	// resolve jumps that were waiting for this block
+	for (size_t i = 0; i < pending_links.size();)
+	{
+		if (pending_links[i].target == address)
+		{
+			link_to(pending_links[i].site, address);
+			pending_links[i] = pending_links.back();
+			pending_links.pop_back();
+		}
+		else i++;
+	}
+
+	for (const link& l : links)
+		link_to(l.site, l.target);
+
+	return start;
+}
+
+void chip8_jit::run(uint64_t cycles)
+{
+	// translated blocks can't be counted, profiling builds interpret
+	if (!code || CHIP8_PROFILE)
+	{
+		while (cycles--)
+			cpu.cycle();
+		return;
+	}
+
+	while (cycles > 0)
+	{
+		uint16_t slot = cpu.pc - MEMORY_START_ADRESS;
+		uint8_t* block = nullptr;
+		if (slot < PROGRAM_SIZE - 1)
+		{
+			block = blocks[slot];
+			if (!block)
+				block = compile(cpu.pc);
+			if (block && block_length[slot] > cycles)
+				block = nullptr;
+		}
+
+		if (!block)
+		{
+			cpu.cycle();
+			cycles--;
+			continue;
+		}
+
+		cycles = entry(&cpu, cycles, block);
+	}
+}
+
+void chip8_jit::translate(const rom_analysis& analysis)
+{
+	if (!code || CHIP8_PROFILE)
+		return;
+
+	for (uint32_t slot = 0; slot < PROGRAM_SIZE - 1; slot++)
+		if (!blocks[slot] && analysis.starts_block(MEMORY_START_ADRESS + slot))
+			compile(MEMORY_START_ADRESS + slot);
+}
+
+#else
+
+chip8_jit::chip8_jit(chip8& interpreter) : cpu(interpreter)
+{
+	cpu.jit = this;
+}
+
+chip8_jit::~chip8_jit()
+{
+	if (cpu.jit == this)
+		cpu.jit = nullptr;
+}
+
+void chip8_jit::run(uint64_t cycles)
+{
+	while (cycles--)
+		cpu.cycle();
+}
+
+void chip8_jit::translate(const rom_analysis& analysis) {}
+void chip8_jit::invalidate(uint16_t address, uint16_t length) {}
+void chip8_jit::flush() {}
+
+#endif
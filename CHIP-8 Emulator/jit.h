@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "analysis.h"
+#include "chip8.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CHIP8_JIT_AVAILABLE 1
+#else
+#define CHIP8_JIT_AVAILABLE 0
+#endif
+
+/*
+	Optional backend that translates basic blocks of CHIP-8 code to x86-64.
+	A block ends at 1nnn, 2nnn, 00EE, Bnnn, the skip instructions or anything
+	that can write memory or wait (Fx0A, Fx33, Fx55). Simple instructions are
+	emitted natively, the rest call back into chip8::execute_instuction, so
+	the result is always the same as calling chip8::cycle() the same number
+	of times. Blocks with a known successor jump straight into it.
+
+	On other architectures run() just falls back to the interpreter.
+*/
+struct chip8_jit
+{
+public:
+	chip8_jit(chip8& interpreter);
+	~chip8_jit();
+
+	chip8_jit(const chip8_jit&) = delete;
+	chip8_jit& operator=(const chip8_jit&) = delete;
+
+	// Executes exactly `cycles` instructions
+	void run(uint64_t cycles);
+
+	// Called by chip8::invalidate when memory gets written
+	void invalidate(uint16_t address, uint16_t length);
+
+	// Translates every block `analysis` found ahead of time, instead of
+	// when run() first gets to it
+	void translate(const rom_analysis& analysis);
+
+	// Throws away every translated block
+	void flush();
+
+	uint32_t translated_blocks() { return block_count; }
+
+private:
+	chip8& cpu;
+
+	struct link
+	{
+		uint8_t* site;
+		uint16_t target;
+	};
+
+	typedef uint64_t (*entry_func)(chip8* cpu, uint64_t budget, uint8_t* block);
+
+	uint8_t* code = nullptr;
+	uint32_t code_size = 0;
+	uint32_t code_used = 0;
+	uint32_t stubs_size = 0;
+	uint8_t* exit_stub = nullptr;
+	entry_func entry = nullptr;
+
+	// Translated code and length in instructions of the block starting
+	// at each address from 0x200 to 0xFFF
+	uint8_t* blocks[PROGRAM_SIZE]{};
+	uint8_t block_length[PROGRAM_SIZE]{};
+	uint32_t block_count = 0;
+
+	// Which bytes of memory belong to a translated block
+	bool translated[4096]{};
+
+	// Jumps to blocks that haven't been translated yet
+	std::vector<link> pending_links;
+
+	uint8_t* compile(uint16_t address);
+	void emit_stubs();
+	void link_to(uint8_t* site, uint16_t target);
+};
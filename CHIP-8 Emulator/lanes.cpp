@@ -0,0 +1,808 @@
+#include "lanes.h"
+#include "savestate.h"
+
+#include <cstring>
+#include <vector>
+
+// Same switches as blit.h: SSE2 is always there on x64, AVX2 only when
+// the compiler is told to use it (premake5 --avx2 or -mavx2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LANES_SSE2 1
+#include <emmintrin.h>
+#else
+#define LANES_SSE2 0
+#endif
+
+#if defined(__AVX2__)
+#define LANES_AVX2 1
+#include <immintrin.h>
+#else
+#define LANES_AVX2 0
+#endif
+
+#define WRAP(address) ((address) & 0xFFFu)
+
+// instructions every lane runs through chip8::run before the pcs get
+// compared again, once the lanes went apart. See run()
+#define DIVERGED_STRETCH 64
+#define MAX_STRETCH 65536
+
+#if LANES_SSE2
+/*
+	The 16 lanes of a byte register are one SSE register, the 16 lanes of
+	pc or I two of them, or one with AVX2. Compares leave 0xFF in the lanes
+	where they hold, 0 elsewhere, skip() turns that into pc += 2.
+*/
+static inline __m128i load_bytes(const uint8_t* lanes)
+{
+	return _mm_loadu_si128((const __m128i*)lanes);
+}
+
+static inline void store_bytes(uint8_t* lanes, __m128i value)
+{
+	_mm_storeu_si128((__m128i*)lanes, value);
+}
+
+// unsigned a > b, SSE2 only compares signed bytes
+static inline __m128i greater(__m128i a, __m128i b)
+{
+	__m128i not_greater = _mm_cmpeq_epi8(_mm_subs_epu8(a, b), _mm_setzero_si128());
+	return _mm_xor_si128(not_greater, _mm_set1_epi8(-1));
+}
+
+// 0 or 1 per lane, for VF
+static inline __m128i flag(__m128i mask)
+{
+	return _mm_and_si128(mask, _mm_set1_epi8(1));
+}
+
+#if LANES_AVX2
+typedef __m256i words;
+
+static inline words load_words(const uint16_t* lanes) { return _mm256_loadu_si256((const __m256i*)lanes); }
+static inline void store_words(uint16_t* lanes, words value) { _mm256_storeu_si256((__m256i*)lanes, value); }
+static inline words splat_words(uint16_t value) { return _mm256_set1_epi16((short)value); }
+static inline words add_words(words a, words b) { return _mm256_add_epi16(a, b); }
+static inline words and_words(words a, words b) { return _mm256_and_si256(a, b); }
+static inline words multiply_words(words a, words b) { return _mm256_mullo_epi16(a, b); }
+static inline words zero_extend(__m128i bytes) { return _mm256_cvtepu8_epi16(bytes); }
+static inline words sign_extend(__m128i bytes) { return _mm256_cvtepi8_epi16(bytes); }
+
+static inline bool all_equal(words a, words b)
+{
+	return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, b)) == 0xFFFFFFFFu;
+}
+#else
+struct words { __m128i low, high; };
+
+static inline words load_words(const uint16_t* lanes)
+{
+	return { _mm_loadu_si128((const __m128i*)lanes), _mm_loadu_si128((const __m128i*)(lanes + 8)) };
+}
+
+static inline void store_words(uint16_t* lanes, words value)
+{
+	_mm_storeu_si128((__m128i*)lanes, value.low);
+	_mm_storeu_si128((__m128i*)(lanes + 8), value.high);
+}
+
+static inline words splat_words(uint16_t value) { return { _mm_set1_epi16((short)value), _mm_set1_epi16((short)value) }; }
+static inline words add_words(words a, words b) { return { _mm_add_epi16(a.low, b.low), _mm_add_epi16(a.high, b.high) }; }
+static inline words and_words(words a, words b) { return { _mm_and_si128(a.low, b.low), _mm_and_si128(a.high, b.high) }; }
+static inline words multiply_words(words a, words b) { return { _mm_mullo_epi16(a.low, b.low), _mm_mullo_epi16(a.high, b.high) }; }
+
+static inline words zero_extend(__m128i bytes)
+{
+	return { _mm_unpacklo_epi8(bytes, _mm_setzero_si128()), _mm_unpackhi_epi8(bytes, _mm_setzero_si128()) };
+}
+
+// only for masks, 0xFF becomes 0xFFFF
+static inline words sign_extend(__m128i bytes)
+{
+	return { _mm_unpacklo_epi8(bytes, bytes), _mm_unpackhi_epi8(bytes, bytes) };
+}
+
+static inline bool all_equal(words a, words b)
+{
+	int low = _mm_movemask_epi8(_mm_cmpeq_epi16(a.low, b.low));
+	int high = _mm_movemask_epi8(_mm_cmpeq_epi16(a.high, b.high));
+	return (low & high) == 0xFFFF;
+}
+#endif
+
+static inline void skip(uint16_t* pc, __m128i mask)
+{
+	store_words(pc, add_words(load_words(pc), and_words(sign_extend(mask), splat_words(2))));
+}
+
+static inline __m128i rotate(__m128i x, int k)
+{
+	return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+}
+
+// random_next() on 4 lanes, returns the top byte of each result. x * 5
+// and x * 9 are shifts and adds, SSE2 has no 32 bit multiply
+static inline __m128i random_top(uint32_t* s0, uint32_t* s1, uint32_t* s2, uint32_t* s3)
+{
+	__m128i a = _mm_loadu_si128((const __m128i*)s0);
+	__m128i b = _mm_loadu_si128((const __m128i*)s1);
+	__m128i c = _mm_loadu_si128((const __m128i*)s2);
+	__m128i d = _mm_loadu_si128((const __m128i*)s3);
+
+	__m128i times5 = _mm_add_epi32(b, _mm_slli_epi32(b, 2));
+	__m128i rotated = rotate(times5, 7);
+	__m128i result = _mm_add_epi32(rotated, _mm_slli_epi32(rotated, 3));
+	__m128i t = _mm_slli_epi32(b, 9);
+
+	c = _mm_xor_si128(c, a);
+	d = _mm_xor_si128(d, b);
+	b = _mm_xor_si128(b, c);
+	a = _mm_xor_si128(a, d);
+	c = _mm_xor_si128(c, t);
+	d = rotate(d, 11);
+
+	_mm_storeu_si128((__m128i*)s0, a);
+	_mm_storeu_si128((__m128i*)s1, b);
+	_mm_storeu_si128((__m128i*)s2, c);
+	_mm_storeu_si128((__m128i*)s3, d);
+	return _mm_srli_epi32(result, 24);
+}
+#endif
+
+chip8_lanes::chip8_lanes()
+{
+	stretch = DIVERGED_STRETCH;
+	for (uint32_t l = 0; l < LANES; l++)
+	{
+		instances[l] = std::make_unique<chip8>();
+		memory[l] = instances[l]->memory;
+		display[l] = instances[l]->display;
+	}
+}
+
+void chip8_lanes::set_lane(uint32_t lane, const chip8& state)
+{
+	std::vector<uint8_t> buffer(STATE_SIZE);
+	state.save_state(buffer.data());
+	instances[lane]->load_state(buffer.data(), buffer.size());
+
+	keypad[lane] = 0;
+	for (uint32_t k = 0; k < 16; k++)
+		keypad[lane] |= (state.keypad[k] ? 1u : 0u) << k;
+
+	if (!apart)
+		load_lane(lane);
+	memset(code, CODE_UNKNOWN, sizeof(code));
+}
+
+void chip8_lanes::get_lane(uint32_t lane, chip8& state) const
+{
+	std::vector<uint8_t> buffer(STATE_SIZE);
+	instances[lane]->save_state(buffer.data());
+	state.load_state(buffer.data(), buffer.size());
+
+	for (uint32_t k = 0; k < 16; k++)
+		state.keypad[k] = (keypad[lane] >> k) & 1u;
+
+	if (apart)
+		return;
+
+	for (uint32_t r = 0; r < 16; r++)
+	{
+		state.registers[r] = registers[r][lane];
+		state.stack[r] = stack[r][lane];
+	}
+	state.index = index[lane];
+	state.pc = pc[lane];
+	state.stack_pointer = stack_pointer[lane];
+	state.delay_timer = delay_timer[lane];
+	state.sound_timer = sound_timer[lane];
+
+	for (uint32_t w = 0; w < 4; w++)
+		state.random_state[w] = random_state[w][lane];
+}
+
+void chip8_lanes::store_lane(uint32_t lane)
+{
+	chip8& to = *instances[lane];
+	for (uint32_t r = 0; r < 16; r++)
+	{
+		to.registers[r] = registers[r][lane];
+		to.stack[r] = stack[r][lane];
+	}
+	to.index = index[lane];
+	to.pc = pc[lane];
+	to.stack_pointer = stack_pointer[lane];
+	to.delay_timer = delay_timer[lane];
+	to.sound_timer = sound_timer[lane];
+
+	for (uint32_t k = 0; k < 16; k++)
+		to.keypad[k] = (keypad[lane] >> k) & 1u;
+	given_keys[lane] = keypad[lane];
+
+	for (uint32_t w = 0; w < 4; w++)
+		to.random_state[w] = random_state[w][lane];
+}
+
+void chip8_lanes::load_lane(uint32_t lane)
+{
+	const chip8& from = *instances[lane];
+	for (uint32_t r = 0; r < 16; r++)
+	{
+		registers[r][lane] = from.registers[r];
+		stack[r][lane] = from.stack[r];
+	}
+	index[lane] = from.index;
+	pc[lane] = from.pc;
+	stack_pointer[lane] = from.stack_pointer;
+	delay_timer[lane] = from.delay_timer;
+	sound_timer[lane] = from.sound_timer;
+
+	for (uint32_t w = 0; w < 4; w++)
+		random_state[w][lane] = from.random_state[w];
+}
+
+void chip8_lanes::leave_lockstep()
+{
+	for (uint32_t l = 0; l < LANES; l++)
+		store_lane(l);
+	apart = true;
+
+	if (joined_steps < DIVERGED_STRETCH)
+		longer_stretch();
+}
+
+void chip8_lanes::longer_stretch()
+{
+	if (stretch < MAX_STRETCH)
+		stretch *= 2;
+}
+
+// Back to lockstep once every lane is at the same pc with the same code
+bool chip8_lanes::rejoin()
+{
+	uint16_t first = instances[0]->pc;
+	for (uint32_t l = 1; l < LANES; l++)
+		if (instances[l]->pc != first)
+			return false;
+
+	// the lanes wrote memory on their own, what was shared might not be
+	memset(code, CODE_UNKNOWN, sizeof(code));
+	if (!shared_code(WRAP(first)))
+		return false;
+
+	for (uint32_t l = 0; l < LANES; l++)
+		load_lane(l);
+	apart = false;
+	return true;
+}
+
+void chip8_lanes::tick_timers()
+{
+	if (apart)
+	{
+		for (uint32_t l = 0; l < LANES; l++)
+			instances[l]->tick_timers();
+		return;
+	}
+
+#if LANES_SSE2
+	store_bytes(delay_timer, _mm_subs_epu8(load_bytes(delay_timer), _mm_set1_epi8(1)));
+	store_bytes(sound_timer, _mm_subs_epu8(load_bytes(sound_timer), _mm_set1_epi8(1)));
+#else
+	for (uint32_t l = 0; l < LANES; l++)
+	{
+		delay_timer[l] -= delay_timer[l] > 0;
+		sound_timer[l] -= sound_timer[l] > 0;
+	}
+#endif
+}
+
+// Whether the opcode at `address` is the same in every lane, the answer
+// is kept until one of its bytes gets written. Shared code also gets the
+// waiting loops of fusion_id::SPIN and fusion_id::DELAY_WAIT marked
+bool chip8_lanes::shared_code(uint16_t address)
+{
+	if (code[address] == CODE_UNKNOWN)
+	{
+		auto same = [&](uint16_t at)
+		{
+			uint8_t byte = memory[0][WRAP(at)];
+			bool equal = true;
+			for (uint32_t l = 1; l < LANES; l++)
+				equal &= memory[l][WRAP(at)] == byte;
+			return equal;
+		};
+		auto opcode = [&](uint16_t at) { return uint16_t((memory[0][WRAP(at)] << 8u) | memory[0][WRAP(at + 1)]); };
+
+		code[address] = CODE_MIXED;
+		if (same(address) && same(address + 1))
+		{
+			instruction& ins = decoded[address];
+			ins = decode_instruction(opcode(address));
+			code[address] = CODE_SHARED;
+
+			if (ins.id == opcode_id::OP_1nnn && ins.nnn == address)
+				ins.fused = (uint8_t)fusion_id::SPIN;
+
+			if (ins.id == opcode_id::OP_Fx07 && same(address + 2) && same(address + 3) && same(address + 4) && same(address + 5))
+			{
+				instruction check = decode_instruction(opcode(address + 2));
+				instruction jump = decode_instruction(opcode(address + 4));
+				if (check.id == opcode_id::OP_3xkk && check.x == ins.x && check.kk == 0 &&
+					jump.id == opcode_id::OP_1nnn && jump.nnn == address)
+					ins.fused = (uint8_t)fusion_id::DELAY_WAIT;
+			}
+		}
+	}
+	return code[address] == CODE_SHARED;
+}
+
+void chip8_lanes::written(uint32_t lane, uint16_t address, uint16_t length)
+{
+	instances[lane]->invalidate(WRAP(address), length);
+
+	// the instruction starting one byte before overlaps the first written
+	// byte, and a waiting loop may start up to two instructions earlier
+	for (uint32_t i = 0; i < length + 5u; i++)
+		code[WRAP(address + i - 5u)] = CODE_UNKNOWN;
+}
+
+/*
+	Lockstep for as long as every lane is at the same pc with the same
+	code there. The waiting loops are taken in one go the way chip8::run
+	does it, as long as every lane leaves them at the same step.
+
+	Apart, every lane runs a stretch of chip8::run. A stretch that ends
+	with the pcs still apart, or a lockstep that doesn't last, makes the
+	next one twice as long, so lanes that never stay together cost about
+	as much as 16 chip8s. Some time back in lockstep brings the short
+	stretches back.
+*/
+void chip8_lanes::run(uint64_t cycles)
+{
+	if (apart)
+		for (uint32_t l = 0; l < LANES; l++)
+			if (given_keys[l] != keypad[l])
+			{
+				for (uint32_t k = 0; k < 16; k++)
+					instances[l]->keypad[k] = (keypad[l] >> k) & 1u;
+				given_keys[l] = keypad[l];
+			}
+
+	uint64_t done = 0;
+	while (done < cycles)
+	{
+		if (apart)
+		{
+			uint64_t length = cycles - done < stretch ? cycles - done : stretch;
+			for (uint32_t l = 0; l < LANES; l++)
+				instances[l]->run(length);
+			diverged_steps += length;
+			done += length;
+
+			if (rejoin())
+				joined_steps = 0;
+			else
+				longer_stretch();
+			continue;
+		}
+
+		uint16_t at = WRAP(pc[0]);
+#if LANES_SSE2
+		bool same_pc = all_equal(load_words(pc), splat_words(pc[0]));
+#else
+		bool same_pc = true;
+		for (uint32_t l = 1; l < LANES; l++)
+			same_pc &= pc[l] == pc[0];
+#endif
+		if (!same_pc || !shared_code(at))
+		{
+			leave_lockstep();
+			continue;
+		}
+
+		const instruction& ins = decoded[at];
+		uint64_t steps = 1;
+
+		// nothing gets out of a SPIN before the end of the batch, a
+		// DELAY_WAIT not before the timers tick unless its timer is 0 already
+		if (ins.fused == (uint8_t)fusion_id::SPIN)
+			steps = cycles - done;
+		else if (ins.fused == (uint8_t)fusion_id::DELAY_WAIT)
+		{
+#if LANES_SSE2
+			uint32_t stopped = _mm_movemask_epi8(_mm_cmpeq_epi8(load_bytes(delay_timer), _mm_setzero_si128()));
+#else
+			uint32_t stopped = 0;
+			for (uint32_t l = 0; l < LANES; l++)
+				stopped |= (delay_timer[l] == 0) << l;
+#endif
+			if (stopped != 0 && stopped != (1u << LANES) - 1u)
+			{
+				leave_lockstep();
+				continue;
+			}
+			if (stopped == 0)
+				steps += (cycles - done - 1) / 3 * 3;
+		}
+
+		step(ins);
+		lockstep_steps += steps;
+		done += steps;
+
+		joined_steps += steps;
+		if (joined_steps >= DIVERGED_STRETCH)
+			stretch = DIVERGED_STRETCH;
+	}
+}
+
+void chip8_lanes::step(const instruction& ins)
+{
+	uint8_t* Vx = registers[ins.x];
+	uint8_t* Vy = registers[ins.y];
+	uint8_t* V0 = registers[0];
+	uint8_t* VF_ = registers[VF];
+
+#if LANES_SSE2
+	store_words(pc, add_words(load_words(pc), splat_words(2)));
+#else
+	for (uint32_t l = 0; l < LANES; l++)
+		pc[l] += 2;
+#endif
+
+	switch (ins.id)
+	{
+	case opcode_id::OP_00E0:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			memset(display[l], 0, SCREEN_HEIGHT * sizeof(uint64_t));
+			instances[l]->dirty_rows = 0xFFFFFFFF;
+			instances[l]->display_generation++;
+		}
+		break;
+
+	case opcode_id::OP_00EE:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			--stack_pointer[l];
+			pc[l] = stack[stack_pointer[l] & 0xFu][l];
+		}
+		break;
+
+	case opcode_id::OP_1nnn:
+#if LANES_SSE2
+		store_words(pc, splat_words(ins.nnn));
+#else
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] = ins.nnn;
+#endif
+		break;
+
+	case opcode_id::OP_2nnn:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			stack[stack_pointer[l]++ & 0xFu][l] = pc[l];
+			pc[l] = ins.nnn;
+		}
+		break;
+
+#if LANES_SSE2
+	case opcode_id::OP_3xkk:
+		skip(pc, _mm_cmpeq_epi8(load_bytes(Vx), _mm_set1_epi8((char)ins.kk)));
+		break;
+
+	case opcode_id::OP_4xkk:
+		skip(pc, _mm_xor_si128(_mm_cmpeq_epi8(load_bytes(Vx), _mm_set1_epi8((char)ins.kk)), _mm_set1_epi8(-1)));
+		break;
+
+	case opcode_id::OP_5xy0:
+		skip(pc, _mm_cmpeq_epi8(load_bytes(Vx), load_bytes(Vy)));
+		break;
+
+	case opcode_id::OP_6xkk:
+		store_bytes(Vx, _mm_set1_epi8((char)ins.kk));
+		break;
+
+	case opcode_id::OP_7xkk:
+		store_bytes(Vx, _mm_add_epi8(load_bytes(Vx), _mm_set1_epi8((char)ins.kk)));
+		break;
+
+	case opcode_id::OP_8xy0:
+		store_bytes(Vx, load_bytes(Vy));
+		break;
+
+	case opcode_id::OP_8xy1:
+		store_bytes(Vx, _mm_or_si128(load_bytes(Vx), load_bytes(Vy)));
+		break;
+
+	case opcode_id::OP_8xy2:
+		store_bytes(Vx, _mm_and_si128(load_bytes(Vx), load_bytes(Vy)));
+		break;
+
+	case opcode_id::OP_8xy3:
+		store_bytes(Vx, _mm_xor_si128(load_bytes(Vx), load_bytes(Vy)));
+		break;
+
+	// the sum is already truncated to 8 bits, so VF is always 0
+	case opcode_id::OP_8xy4:
+	{
+		__m128i sum = _mm_add_epi8(load_bytes(Vx), load_bytes(Vy));
+		store_bytes(VF_, _mm_setzero_si128());
+		store_bytes(Vx, sum);
+		break;
+	}
+
+	// Vx and Vy are loaded again after VF is written, for when one of them is VF
+	case opcode_id::OP_8xy5:
+		store_bytes(VF_, flag(greater(load_bytes(Vx), load_bytes(Vy))));
+		store_bytes(Vx, _mm_sub_epi8(load_bytes(Vx), load_bytes(Vy)));
+		break;
+
+	case opcode_id::OP_8xy7:
+		store_bytes(VF_, flag(greater(load_bytes(Vy), load_bytes(Vx))));
+		store_bytes(Vx, _mm_sub_epi8(load_bytes(Vy), load_bytes(Vx)));
+		break;
+
+	case opcode_id::OP_9xy0:
+		skip(pc, _mm_xor_si128(_mm_cmpeq_epi8(load_bytes(Vx), load_bytes(Vy)), _mm_set1_epi8(-1)));
+		break;
+
+	case opcode_id::OP_Annn:
+		store_words(index, splat_words(ins.nnn));
+		break;
+
+	case opcode_id::OP_Bnnn:
+		store_words(pc, add_words(zero_extend(load_bytes(V0)), splat_words(ins.nnn)));
+		break;
+
+	case opcode_id::OP_Cxkk:
+	{
+		__m128i top[4];
+		for (uint32_t g = 0; g < 4; g++)
+			top[g] = random_top(random_state[0] + g * 4, random_state[1] + g * 4, random_state[2] + g * 4, random_state[3] + g * 4);
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(top[0], top[1]), _mm_packs_epi32(top[2], top[3]));
+		store_bytes(Vx, _mm_and_si128(bytes, _mm_set1_epi8((char)ins.kk)));
+		break;
+	}
+
+	case opcode_id::OP_Fx07:
+		store_bytes(Vx, load_bytes(delay_timer));
+		break;
+
+	case opcode_id::OP_Fx15:
+		store_bytes(delay_timer, load_bytes(Vx));
+		break;
+
+	case opcode_id::OP_Fx18:
+		store_bytes(sound_timer, load_bytes(Vx));
+		break;
+
+	case opcode_id::OP_Fx1E:
+		store_words(index, add_words(load_words(index), zero_extend(load_bytes(Vx))));
+		break;
+
+	case opcode_id::OP_Fx29:
+		store_words(index, add_words(multiply_words(zero_extend(load_bytes(Vx)), splat_words(5)), splat_words(FONTSET_START_ADRESS)));
+		break;
+#else
+	case opcode_id::OP_3xkk:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] += Vx[l] == ins.kk ? 2 : 0;
+		break;
+
+	case opcode_id::OP_4xkk:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] += Vx[l] != ins.kk ? 2 : 0;
+		break;
+
+	case opcode_id::OP_5xy0:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] += Vx[l] == Vy[l] ? 2 : 0;
+		break;
+
+	case opcode_id::OP_6xkk:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] = ins.kk;
+		break;
+
+	case opcode_id::OP_7xkk:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] += ins.kk;
+		break;
+
+	case opcode_id::OP_8xy0:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] = Vy[l];
+		break;
+
+	case opcode_id::OP_8xy1:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] |= Vy[l];
+		break;
+
+	case opcode_id::OP_8xy2:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] &= Vy[l];
+		break;
+
+	case opcode_id::OP_8xy3:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] ^= Vy[l];
+		break;
+
+	// the sum is already truncated to 8 bits, so VF is always 0
+	case opcode_id::OP_8xy4:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			uint8_t sum = Vx[l] + Vy[l];
+			VF_[l] = 0;
+			Vx[l] = sum;
+		}
+		break;
+
+	case opcode_id::OP_8xy5:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			VF_[l] = Vx[l] > Vy[l];
+			Vx[l] -= Vy[l];
+		}
+		break;
+
+	case opcode_id::OP_8xy7:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			VF_[l] = Vy[l] > Vx[l];
+			Vx[l] = Vy[l] - Vx[l];
+		}
+		break;
+
+	case opcode_id::OP_9xy0:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] += Vx[l] != Vy[l] ? 2 : 0;
+		break;
+
+	case opcode_id::OP_Annn:
+		for (uint32_t l = 0; l < LANES; l++)
+			index[l] = ins.nnn;
+		break;
+
+	case opcode_id::OP_Bnnn:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] = V0[l] + ins.nnn;
+		break;
+
+	case opcode_id::OP_Cxkk:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] = uint8_t(random_next(random_state[0][l], random_state[1][l], random_state[2][l], random_state[3][l]) >> 24u) & ins.kk;
+		break;
+
+	case opcode_id::OP_Fx07:
+		for (uint32_t l = 0; l < LANES; l++)
+			Vx[l] = delay_timer[l];
+		break;
+
+	case opcode_id::OP_Fx15:
+		for (uint32_t l = 0; l < LANES; l++)
+			delay_timer[l] = Vx[l];
+		break;
+
+	case opcode_id::OP_Fx18:
+		for (uint32_t l = 0; l < LANES; l++)
+			sound_timer[l] = Vx[l];
+		break;
+
+	case opcode_id::OP_Fx1E:
+		for (uint32_t l = 0; l < LANES; l++)
+			index[l] += Vx[l];
+		break;
+
+	case opcode_id::OP_Fx29:
+		for (uint32_t l = 0; l < LANES; l++)
+			index[l] = FONTSET_START_ADRESS + 5 * Vx[l];
+		break;
+#endif
+
+	// shifts by a different amount in every lane, SSE2 and AVX2 have no
+	// per lane byte shift
+	case opcode_id::OP_8xy6:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			VF_[l] = Vx[l] & 0x1u;
+			Vx[l] = uint8_t(Vx[l] >> Vx[l]);
+		}
+		break;
+
+	case opcode_id::OP_8xyE:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			VF_[l] = (Vx[l] & 0x80u) >> 7u;
+			Vx[l] = uint8_t(Vx[l] << Vx[l]);
+		}
+		break;
+
+	case opcode_id::OP_Dxyn:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			uint8_t x_pos = Vx[l] % SCREEN_WIDTH;
+			uint8_t y_pos = Vy[l] % SCREEN_HEIGHT;
+			uint8_t height = ins.n;
+			if (y_pos + height > SCREEN_HEIGHT)
+				height = SCREEN_HEIGHT - y_pos;
+
+			uint8_t collision = 0;
+			uint32_t changed = 0;
+			for (uint32_t y = 0; y < height; y++)
+			{
+				uint64_t sprite_row = (uint64_t)memory[l][WRAP(index[l] + y)] << 56u >> x_pos;
+				collision |= (display[l][y_pos + y] & sprite_row) != 0;
+				display[l][y_pos + y] ^= sprite_row;
+				changed |= (sprite_row != 0) << (y_pos + y);
+			}
+			VF_[l] = collision;
+
+			if (changed)
+			{
+				instances[l]->dirty_rows |= changed;
+				instances[l]->display_generation++;
+			}
+		}
+		break;
+
+	case opcode_id::OP_Ex9E:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] += (keypad[l] >> (Vx[l] & 0xFu)) & 1u ? 2 : 0;
+		break;
+
+	case opcode_id::OP_ExA1:
+		for (uint32_t l = 0; l < LANES; l++)
+			pc[l] += (keypad[l] >> (Vx[l] & 0xFu)) & 1u ? 0 : 2;
+		break;
+
+	// the highest key held wins, same as the loop in op_Fx0A
+	case opcode_id::OP_Fx0A:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			if (keypad[l] == 0)
+			{
+				pc[l] -= 2;
+				continue;
+			}
+			uint8_t key = 15;
+			while (!((keypad[l] >> key) & 1u))
+				key--;
+			Vx[l] = key;
+		}
+		break;
+
+	case opcode_id::OP_Fx33:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			uint8_t value = Vx[l];
+			memory[l][WRAP(index[l] + 2)] = value % 10;
+			memory[l][WRAP(index[l] + 1)] = value / 10 % 10;
+			memory[l][WRAP(index[l])] = value / 100;
+			written(l, index[l], 3);
+		}
+		break;
+
+	case opcode_id::OP_Fx55:
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			for (uint32_t r = 0; r <= ins.x; r++)
+				memory[l][WRAP(index[l] + r)] = registers[r][l];
+			written(l, index[l], ins.x + 1);
+		}
+		break;
+
+	case opcode_id::OP_Fx65:
+		for (uint32_t r = 0; r <= ins.x; r++)
+			for (uint32_t l = 0; l < LANES; l++)
+				registers[r][l] = memory[l][WRAP(index[l] + r)];
+		break;
+
+	// chip8::op_invalid only complains, nothing changes
+	default:
+		break;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+#include "chip8.h"
+
+// 16 one-byte lanes fill an SSE register, their 16 bit pcs an AVX2 one
+#define LANES 16
+
+/*
+	LANES instances of the same program run side by side, for sweeping one
+	ROM over many inputs or seeds. Every lane is a chip8 of its own, which
+	keeps its memory and display. While every lane is at the same pc and
+	sees the same opcode there the rest of the state lives here lane-major
+	(lane l of V3 is registers[3][l]), one decode serves all of them and
+	the arithmetic, compares and skips are SSE2 / AVX2 ops over every lane
+	at once, see step().
+
+	Once the pcs or the code bytes differ the registers go back into the
+	chip8s, and each one runs stretches of chip8::run with its
+	superinstructions until the pcs agree again. Only the registers move
+	each way, memory and the display stay where they are.
+
+	Same semantics as chip8::cycle() per lane, in lockstep addresses just
+	wrap at 4K instead of reading past memory. Keep in sync with the op_*
+	handlers.
+*/
+struct chip8_lanes
+{
+public:
+	chip8_lanes();
+
+	// Only up to date while the lanes run in lockstep (together() is true),
+	// get_lane() always gives the current state
+	uint8_t registers[16][LANES]{};
+	uint16_t index[LANES]{};
+	uint16_t pc[LANES]{};
+	uint16_t stack[16][LANES]{};
+	uint8_t stack_pointer[LANES]{};
+	uint8_t delay_timer[LANES]{};
+	uint8_t sound_timer[LANES]{};
+
+	// word w of lane l's Cxkk generator is random_state[w][l]
+	uint32_t random_state[4][LANES]{};
+
+	// bit k is key k, can be changed between any two calls to run()
+	uint16_t keypad[LANES]{};
+
+	// Copies a scalar instance into / out of lane `lane`
+	void set_lane(uint32_t lane, const chip8& state);
+	void get_lane(uint32_t lane, chip8& state) const;
+
+	// Executes `cycles` instructions on every lane, timers are left alone
+	void run(uint64_t cycles);
+	void tick_timers();
+
+	bool together() const { return !apart; }
+
+	// Steps where all lanes went through one decode, and where they ran
+	// chip8::run on their own
+	uint64_t lockstep_steps = 0;
+	uint64_t diverged_steps = 0;
+
+private:
+	enum code_state : uint8_t
+	{
+		CODE_UNKNOWN,
+		CODE_SHARED,    // decoded[] holds the opcode every lane has there
+		CODE_MIXED
+	};
+
+	std::unique_ptr<chip8> instances[LANES];
+
+	// instances[l]->memory and ->display, for the lockstep loops
+	uint8_t* memory[LANES]{};
+	uint64_t* display[LANES]{};
+
+	bool apart = false;
+
+	// see run()
+	uint64_t stretch = 0;
+	uint64_t joined_steps = 0;
+
+	// keypad[] as the chip8s last got it
+	uint16_t given_keys[LANES]{};
+
+	instruction decoded[4096]{};
+	uint8_t code[4096]{};
+
+	bool shared_code(uint16_t address);
+	void written(uint32_t lane, uint16_t address, uint16_t length);
+
+	// Moves the registers of `lane` from the arrays above into its chip8 / back
+	void store_lane(uint32_t lane);
+	void load_lane(uint32_t lane);
+	void leave_lockstep();
+	bool rejoin();
+	void longer_stretch();
+
+	// Runs `ins` on every lane
+	void step(const instruction& ins);
+};
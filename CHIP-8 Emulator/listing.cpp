@@ -0,0 +1,21 @@
+#include "listing.h"
+
+void rom_listing::build(const uint8_t* memory)
+{
+	patch(memory, 0, 4096);
+}
+
+void rom_listing::patch(const uint8_t* memory, uint16_t address, uint16_t length)
+{
+	// the line starting one byte before has the first written byte as
+	// its second half
+	uint32_t first = address > 0 ? address - 1u : 0;
+	uint32_t last = address + length < 4096u ? address + length : 4096u;
+
+	for (uint32_t at = first; at < last; at++)
+	{
+		uint16_t opcode = (memory[at] << 8u) | memory[(at + 1u) & 0xFFFu];
+		lengths[at] = (uint8_t)disassemble(opcode, lines[at]);
+	}
+	changes++;
+}
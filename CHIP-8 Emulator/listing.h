@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+#include "disassembler.h"
+
+/*
+	The disassembly of every address, as if an instruction started there,
+	so odd addresses are covered too. Attached to a chip8 (chip8::listing)
+	it gets rebuilt by load_rom and reset and only the lines a write
+	touches are redone after that, through chip8::invalidate. Whatever
+	shows code then only copies lines out.
+*/
+struct rom_listing
+{
+public:
+	void build(const uint8_t* memory);
+
+	// Redoes the lines that overlap [address, address + length)
+	void patch(const uint8_t* memory, uint16_t address, uint16_t length);
+
+	std::string_view at(uint16_t address) const
+	{
+		return std::string_view(lines[address & 0xFFFu], lengths[address & 0xFFFu]);
+	}
+
+	// goes up every time a line changes
+	uint32_t version() const { return changes; }
+
+private:
+	char lines[4096][DISASSEMBLY_LENGTH];
+	uint8_t lengths[4096];
+	uint32_t changes = 0;
+};
@@ -1,10 +1,14 @@
 #include "framework.h"
 #include "chip8.h"
+#include "emulation.h"
+#include "rom_database.h"
+#include "rom_library.h"
 
 #include <sstream>
 #include <queue>
 #include <filesystem>
 #include <algorithm>
+#include <ctime>
 
 class CHIP8_emulator : public fm::application
 {
@@ -12,6 +16,10 @@ public:
 	CHIP8_emulator() = default;
 	~CHIP8_emulator()
 	{
+		// the audio thread reads from the emulation
+		close_audio();
+		emu.stop();
+		database.save();
 		delete fm;
 	}
 
@@ -19,101 +27,239 @@ public:
 	{
 		load_font("font/");
 
-		interpreter.initialize();
+		// CHIP8_ROMS can point at another folder or an archive, otherwise
+		// roms.c8ra is used when there is one and the roms folder if not
 		std::string path = "roms/";
-		for (const auto& game : std::filesystem::directory_iterator(path))
-			available_games.push_back(game.path().string());
-		rom_title = available_games[game_index];
-		rom_title = rom_title.substr(rom_title.find_first_of('/') + 1);
-		interpreter.load_rom(path + rom_title);
+		if (const char* roms = getenv("CHIP8_ROMS"))
+			path = roms;
+		else if (std::filesystem::exists("roms" ROM_ARCHIVE_EXTENSION))
+			path = "roms" ROM_ARCHIVE_EXTENSION;
+
+		// what was found out about every rom played so far, see rom_database.h
+		const char* db = getenv("CHIP8_DB");
+		database.open(db ? db : "roms.c8db");
+
+		if (!library.open(path) || library.size() == 0)
+			std::cout << "no roms in " << path << "\n";
+		else
+			switch_game(0);
+		emu.set_speed(speeds[speed_index]);
 
 		fm = new fm::framebuffer(64, 32);
 
+		// the beeper plays whatever the emulation has ready, never waiting for it
+		if (!open_audio(AUDIO_SAMPLE_RATE, [this](int16_t* samples, uint32_t count) { emu.audio.pop(samples, count); }))
+			std::cout << "no audio device\n";
+
+		// CHIP8_THREAD=0 keeps the emulation on the ui thread from the start
+		const char* thread = getenv("CHIP8_THREAD");
+		if (!thread || strcmp(thread, "0") != 0)
+			emu.start();
 	}
 	void on_update(float dt) override
 	{
-		if (current_time > cycle_delay)
+		process_input();
+		if (!emu.threaded())
+			emu.step(dt);
+
+		// the emulation publishes at most one frame per display refresh
+		if (emu.frames.update())
 		{
+			const emulated_frame& frame = emu.frames.front();
+
 			uint32_t separator_x = 64 * 3 - 1;
 			uint32_t title_pos =  separator_x / 2.0f;
 			std::string title = "< " + rom_title + " >";
 			uint32_t title_width = get_text_width(title, 2);
 
-			clear(fm::color(0.0f, 0.0f, 0.0f));
+			// the chip-8 screen keeps what was drawn last time, only the
+			// title and the cpu panel get cleared
+			draw_quad_fill(fm::color(0.0f, 0.0f, 0.0f), 0, screen_height() - 20, separator_x, 20);
+			draw_quad_fill(fm::color(0.0f, 0.0f, 0.0f), separator_x + 1, 0, screen_width() - separator_x - 1, screen_height());
+			draw_quad_fill(fm::color(0.0f, 0.0f, 0.0f), 0, 0, separator_x, 35);
 			draw_text(title, title_pos - title_width / 2, screen_height() - 20.0f, 2, fm::color(1.0f, 1.0f, 1.0f));
-			draw_cpu();
-			process_input();
-			interpreter.cycle();
-			current_time = 0.0f;
-			present();
+			draw_cpu(frame);
+			present(frame);
 			draw_line(fm::color(1.0f, 1.0f, 1.0f), separator_x, 0, separator_x, screen_height());
+
+			fm::v2<uint32_t> text_pos(195u, 35u);
+			text_pos.y -= 10;
+			std::string speed = speeds[speed_index] ? std::to_string(speeds[speed_index]) + " ips" : "unlimited";
+			draw_text("Speed: " + speed, text_pos.x, text_pos.y, 1, fm::color(1.0f, 1.0f, 1.0f));
+			text_pos.y -= 10;
+			draw_text("[ and ] to modify", text_pos.x, text_pos.y, 1, fm::color(1.0f, 1.0f, 1.0f));
+			text_pos.y -= 10;
+			draw_text(emu.threaded() ? "T: own thread" : "T: ui thread", text_pos.x, text_pos.y, 1, fm::color(1.0f, 1.0f, 1.0f));
+
+			draw_rewind(frame);
+#if CHIP8_PROFILE
+			draw_profile(frame);
+#endif
 		}
 
-		bool change_game = false;
-		if (get_key(fm::Key::RIGHT).pressed)
-			game_index++, change_game = true;
-		else if (get_key(fm::Key::LEFT).pressed)
-			game_index--, change_game = true;
+		// the library has every rom in memory already, switching is a copy
+		if (library.size())
+		{
+			if (get_key(fm::Key::RIGHT).pressed)
+				switch_game((game_index + 1) % library.size());
+			else if (get_key(fm::Key::LEFT).pressed)
+				switch_game((game_index + library.size() - 1) % library.size());
+		}
 
-		if (change_game)
+		// [ slows down, ] speeds up, the last step is unlimited
+		if (get_key(fm::Key::LEFT_BRACKET).pressed && speed_index > 0)
 		{
-			if (game_index < 0)
-				game_index = available_games.size() - 1;
-			if (game_index >= available_games.size())
-				game_index = 0;
-
-			//op_00E0
-			memset(interpreter.display, 0x00000000, sizeof(interpreter.display));
-			rom_title = available_games[game_index];
-			rom_title = rom_title.substr(rom_title.find_first_of('/') + 1);
-			interpreter.load_rom("roms/" + rom_title);
+			speed_index--;
+			remember_speed();
 		}
 
+		if (get_key(fm::Key::RIGHT_BRACKET).pressed && speed_index < speeds.size() - 1)
+		{
+			speed_index++;
+			remember_speed();
+		}
 
-		current_time += dt;
-		if (get_key(fm::Key::LEFT_BRACKET).pressed)
-			cycle_delay -= 0.01f;
+		emu.set_speed(speeds[speed_index]);
 
-		if (get_key(fm::Key::RIGHT_BRACKET).pressed)
-			cycle_delay += 0.02f;
+		// F5 starts and stops logging the input to recordings/, the logs
+		// play back with batch-runner --replay
+		if (get_key(fm::Key::F5).pressed)
+		{
+			if (recording)
+				emu.stop_recording();
+			else
+			{
+				std::filesystem::create_directories("recordings");
+				std::string name = rom_title.substr(0, rom_title.find_last_of('.'));
+				emu.start_recording("recordings/" + name + "-" + std::to_string(time(NULL)) + ".c8log");
+			}
+			recording = !recording;
+		}
 
-		if (cycle_delay < 0.0f)
-			cycle_delay = 0.0f;
+		// F6 streams every executed instruction to traces/, the files turn
+		// into text with batch-runner --trace
+		if (get_key(fm::Key::F6).pressed)
+		{
+			if (tracing)
+				emu.stop_trace();
+			else
+			{
+				std::filesystem::create_directories("traces");
+				std::string name = rom_title.substr(0, rom_title.find_last_of('.'));
+				emu.start_trace("traces/" + name + "-" + std::to_string(time(NULL)) + ".c8tr");
+			}
+			tracing = !tracing;
+		}
 
-		if (cycle_delay > 0.5f)
-			cycle_delay = 0.5f;
+		// moves the emulation between its own thread and this one
+		if (get_key(fm::Key::T).pressed)
+		{
+			if (emu.threaded())
+				emu.stop();
+			else
+				emu.start();
+		}
 
 		if (get_key(fm::Key::N2).pressed)
 			std::cout << "DA";
-
-		fm::v2<uint32_t> text_pos(195u, 35u);
-		// quick and dirty way to clear a portion of the screen
-		draw_quad_fill(fm::color(0.0f, 0.0f, 0.0f), text_pos.x, 5u, 130u, 30u);
-		text_pos.y -= 10;
-		draw_text("Cycle delay: " + std::to_string(cycle_delay), text_pos.x, text_pos.y, 1, fm::color(1.0f, 1.0f, 1.0f));
-		text_pos.y -= 10;
-		draw_text("[ and ] to modify", text_pos.x, text_pos.y, 1, fm::color(1.0f, 1.0f, 1.0f));
-
 	}
 
-	void present()
+	// Redraws the rows of the chip-8 display that changed since the last
+	// frame that was presented, nothing at all if none did
+	void present(const emulated_frame& frame)
 	{
-		fm->set_buffer(interpreter.display);
-		draw_framebuffer(fm, 0, 35, 3);
+		if (presented_any && frame.display_generation == presented_generation)
+			return;
+
+		// the dirty rows only cover the step from the frame before, when
+		// frames got skipped in between everything is redrawn
+		uint32_t rows = presented_any && frame.previous_generation == presented_generation ? frame.dirty_rows : 0xFFFFFFFF;
+		presented_generation = frame.display_generation;
+		presented_any = true;
+
+		if (!rows)
+			return;
+
+		get_pixels(frame, rows);
+
+		// one copy and one draw per run of consecutive dirty rows
+		uint32_t row = 0;
+		while (row < SCREEN_HEIGHT)
+		{
+			if (!(rows & (1u << row)))
+			{
+				row++;
+				continue;
+			}
+
+			uint32_t first = row;
+			while (row < SCREEN_HEIGHT && (rows & (1u << row)))
+				row++;
+
+			fm->set_rows(pixels, first, row - first);
+			draw_framebuffer(fm, 0, 35, 3, first, row - first);
+		}
 	}
 
 private:
-	chip8 interpreter;
+	emulation emu;
 	std::string rom_title;
 	fm::framebuffer* fm;
-	float cycle_delay = 0.2f;
-	float current_time = cycle_delay;
-	uint16_t pcs[4];
-	uint16_t first_available = 0;
-	std::vector<std::string> available_games;
+	uint32_t pixels[SCREEN_WIDTH * SCREEN_HEIGHT];
+	// display_generation of what is on the window, the first frame draws every row
+	uint32_t presented_generation = 0;
+	bool presented_any = false;
+	std::vector<uint32_t> speeds = { 500, 700, 1000, 2000, 5000, 10000, 100000, 1000000, 0 };
+	uint32_t speed_index = 1;
+	rom_library library;
+	rom_database database;
 	uint32_t game_index = 0;
+	bool recording = false;
+	bool tracing = false;
 
 private:
+	// Roms played before start at the speed they were left at and come
+	// with their analysis, new ones get analysed once and remembered
+	void switch_game(uint32_t index)
+	{
+		const rom_entry& rom = library[index];
+		const uint8_t* data = library.data(rom);
+		game_index = index;
+		rom_title = rom.name;
+
+		const rom_record* known = database.find(rom.hash, rom.size);
+		if (!known)
+		{
+			rom_record record{};
+			record.hash = rom.hash;
+			record.size = rom.size;
+			analyze_rom(data, rom.size, record.analysis);
+			record.analysis_version = ROM_ANALYSIS_VERSION;
+			known = database.store(record);
+		}
+
+		auto speed = std::find(speeds.begin(), speeds.end(), known->ips);
+		if ((known->flags & ROM_RECORD_IPS) && speed != speeds.end())
+			speed_index = uint32_t(speed - speeds.begin());
+
+		emu.load_rom(rom.name, data, rom.size, &known->analysis);
+	}
+
+	void remember_speed()
+	{
+		if (library.size() == 0)
+			return;
+
+		const rom_entry& rom = library[game_index];
+		if (const rom_record* known = database.find(rom.hash, rom.size))
+		{
+			rom_record record = *known;
+			record.flags |= ROM_RECORD_IPS;
+			record.ips = speeds[speed_index];
+			database.store(record);
+		}
+	}
+
 	std::string hex(uint32_t n, uint8_t d)
 	{
 		std::string s(d, '0');
@@ -122,7 +268,19 @@ private:
 		return s;
 	};
 
-	void draw_cpu()
+	// same as chip8::get_pixels, for a published frame
+	void get_pixels(const emulated_frame& frame, uint32_t rows)
+	{
+		for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
+		{
+			if (!(rows & (1u << y)))
+				continue;
+			for (uint32_t x = 0; x < SCREEN_WIDTH; x++)
+				pixels[y * SCREEN_WIDTH + x] = (frame.display[y] >> (63u - x)) & 1u ? 0xFFFFFFFF : 0x00000000;
+		}
+	}
+
+	void draw_cpu(const emulated_frame& frame)
 	{
 		fm::color text_color(1.0f, 1.0f, 1.0f);
 		fm::v2<uint32_t> text_pos(195, 150);
@@ -134,53 +292,96 @@ private:
 
 		text_pos.y -= 10;
 		for (int i = 0; i < 4; i++)
-			draw_text(std::to_string(interpreter.registers[i]),
+			draw_text(std::to_string(frame.registers[i]),
 				text_pos.x + i * 32, text_pos.y, 1, text_color);
 
 		text_pos.y -= 10;
 		for (int i = 4; i < 8; i++)
-			draw_text(std::to_string(interpreter.registers[i]),
+			draw_text(std::to_string(frame.registers[i]),
 				text_pos.x + (i - 4) * 32, text_pos.y, 1, text_color);
 
 		text_pos.y -= 10;
 		for (int i = 8; i < 12; i++)
-			draw_text(std::to_string(interpreter.registers[i]),
+			draw_text(std::to_string(frame.registers[i]),
 				text_pos.x + (i - 8) * 32, text_pos.y, 1, text_color);
 
 		text_pos.y -= 10;
 		for (int i = 12; i < 16; i++)
-			draw_text(std::to_string(interpreter.registers[i]),
+			draw_text(std::to_string(frame.registers[i]),
 				text_pos.x + (i - 12) * 32, text_pos.y, 1, text_color);
 
 		draw_quad(fm::color(1.0f, 1.0f, 1.0f), text_pos.x - 2, text_pos.y - 2, 120, 40);
 		text_pos.y -= 10;
-		draw_text("Program counter: 0x" + hex(interpreter.pc, 4), text_pos.x, text_pos.y, 1, text_color);
+		draw_text("Program counter: 0x" + hex(frame.pc, 4), text_pos.x, text_pos.y, 1, text_color);
 
 		text_pos.y -= 10;
-		draw_text("Stack pointer: " + std::to_string(interpreter.stack_pointer), text_pos.x, text_pos.y, 1, text_color);
-	
-		if (first_available == 4)
-		{
-			first_available = 3;
-			for (int i = 0; i < 3; i++)
-				pcs[i] = pcs[i + 1];
-		}
-		pcs[first_available++] = (interpreter.memory[interpreter.pc] << 8u) | interpreter.memory[interpreter.pc + 1];
+		draw_text("Stack pointer: " + std::to_string(frame.stack_pointer), text_pos.x, text_pos.y, 1, text_color);
 
+		// the last instructions from the trace ring, the text comes from
+		// the listing the emulation keeps
 		text_pos.y -= 10;
-		draw_text("Instructions: ", text_pos.x, text_pos.y, 1, text_color);
-		for (uint32_t i = 0; i < first_available; i++)
+		if (frame.trace_streaming)
+			draw_text("Streaming, " + std::to_string(frame.trace_dropped) + " lost", text_pos.x, text_pos.y, 1, text_color);
+		else
+			draw_text(frame.trace_count ? "Instructions, F6: save" : "Not traced when unlimited", text_pos.x, text_pos.y, 1, text_color);
+		for (uint32_t i = 0; i < frame.trace_count; i++)
 		{
+			const trace_record& record = frame.trace[i];
 			text_pos.y -= 10;
-			draw_text("0x" + hex(pcs[i], 4) + " " + interpreter.get_instruction_name(pcs[i]), text_pos.x, text_pos.y, 1, text_color);
+			draw_text(hex(record.pc, 3) + " " + hex(record.opcode, 4) + " " + frame.trace_text[i],
+				text_pos.x, text_pos.y, 1, text_color);
 		}
-		for (uint32_t i = 0; i < 4 - first_available; i++)
+		for (uint32_t i = frame.trace_count; i < TRACE_SHOWN; i++)
 			text_pos.y -= 10;
 
 		draw_quad(fm::color(1.0f, 1.0f, 1.0f), text_pos.x - 2, text_pos.y - 2, 120, 40);
 
 	}
 
+	// under the chip-8 screen
+	void draw_rewind(const emulated_frame& frame)
+	{
+		fm::color text_color(1.0f, 1.0f, 1.0f);
+		char line[64];
+
+		draw_text(frame.rewinding ? "<< Rewinding" : "BACKSPACE: rewind", 2, 25, 1, text_color);
+
+		if (frame.recording_bytes)
+			snprintf(line, sizeof(line), "REC %.1f KB, F5: stop", frame.recording_bytes / 1024.0f);
+		else
+			snprintf(line, sizeof(line), "F5: record input");
+		draw_text(line, screen_width() - get_text_width(line, 1) - 2, 190, 1, text_color);
+
+		snprintf(line, sizeof(line), "%u states, %.1f/%.0f MB, %.1f us", frame.rewind_states,
+			frame.rewind_bytes / (1024.0f * 1024.0f), frame.rewind_capacity / (1024.0f * 1024.0f), frame.rewind_microseconds);
+		draw_text(line, 2, 15, 1, text_color);
+
+		snprintf(line, sizeof(line), "Audio %.1f ms, %llu under, %llu over", frame.audio_queued * 1000.0f / AUDIO_SAMPLE_RATE,
+			(unsigned long long)frame.audio_underruns, (unsigned long long)frame.audio_overruns);
+		draw_text(line, 2, 5, 1, text_color);
+	}
+
+#if CHIP8_PROFILE
+	// the hottest addresses of the rom so far, between the chip-8 screen
+	// and the title
+	void draw_profile(const emulated_frame& frame)
+	{
+		fm::color text_color(1.0f, 1.0f, 1.0f);
+		uint32_t separator_x = 64 * 3 - 1;
+		draw_quad_fill(fm::color(0.0f, 0.0f, 0.0f), 0, 135, separator_x, 45);
+
+		// the font has no percent sign
+		draw_text("Hot addresses, percent of all:", 2, 170, 1, text_color);
+		for (uint32_t i = 0; i < PROFILE_HOT_ADDRESSES && frame.hot[i].count; i++)
+		{
+			char line[64];
+			snprintf(line, sizeof(line), "0x%03X %5.1f %s", frame.hot[i].address,
+				100.0 * frame.hot[i].count / frame.profiled_instructions, frame.hot_text[i]);
+			draw_text(line, 2, 160 - i * 10, 1, text_color);
+		}
+	}
+#endif
+
 	void process_input()
 	{
 		/*
@@ -195,22 +396,19 @@ private:
 		 +-+-+-+-+    +-+-+-+-+
 		*/
 
-		interpreter.keypad[0]   = get_key(fm::Key::X).held;
-		interpreter.keypad[1]   = get_key(fm::Key::N1).held;
-		interpreter.keypad[2]   = get_key(fm::Key::N2).held;
-		interpreter.keypad[3]   = get_key(fm::Key::N3).held;
-		interpreter.keypad[4]   = get_key(fm::Key::Q).held;
-		interpreter.keypad[5]   = get_key(fm::Key::W).held;
-		interpreter.keypad[6]   = get_key(fm::Key::E).held;
-		interpreter.keypad[7]   = get_key(fm::Key::A).held;
-		interpreter.keypad[8]   = get_key(fm::Key::S).held;
-		interpreter.keypad[9]   = get_key(fm::Key::D).held;
-		interpreter.keypad[0xA] = get_key(fm::Key::Z).held;
-		interpreter.keypad[0xB] = get_key(fm::Key::C).held;
-		interpreter.keypad[0xC] = get_key(fm::Key::N4).held;
-		interpreter.keypad[0xD] = get_key(fm::Key::R).held;
-		interpreter.keypad[0xE] = get_key(fm::Key::F).held;
-		interpreter.keypad[0xF] = get_key(fm::Key::V).held;
+		static const fm::Key layout[16] = {
+			fm::Key::X,  fm::Key::N1, fm::Key::N2, fm::Key::N3,
+			fm::Key::Q,  fm::Key::W,  fm::Key::E,  fm::Key::A,
+			fm::Key::S,  fm::Key::D,  fm::Key::Z,  fm::Key::C,
+			fm::Key::N4, fm::Key::R,  fm::Key::F,  fm::Key::V
+		};
+
+		uint16_t keys = 0;
+		for (uint32_t i = 0; i < 16; i++)
+			if (get_key(layout[i]).held)
+				keys |= 1u << i;
+		emu.set_keys(keys);
+		emu.set_rewinding(get_key(fm::Key::BACKSPACE).held);
 
 	}
 };
@@ -0,0 +1,85 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+bool mapped_file::open(const std::string& filepath)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return false;
+
+	void* mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+	handle = mapping;
+	view = mapped;
+	view_size = (size_t)file_size.QuadPart;
+#else
+	int file = ::open(filepath.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (mapped == MAP_FAILED)
+		return false;
+
+	view = mapped;
+	view_size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (!view)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+	CloseHandle(handle);
+	handle = nullptr;
+#else
+	munmap(view, view_size);
+#endif
+	view = nullptr;
+	view_size = 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read only (mmap, MapViewOfFile on windows)
+struct mapped_file
+{
+public:
+	mapped_file() = default;
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	// Fails for files that can't be opened and for empty ones
+	bool open(const std::string& filepath);
+	void close();
+
+	const uint8_t* data() const { return (const uint8_t*)view; }
+	size_t size() const { return view_size; }
+	bool is_open() const { return view != nullptr; }
+
+private:
+	void* view = nullptr;
+	size_t view_size = 0;
+#ifdef _WIN32
+	void* handle = nullptr;
+#endif
+};
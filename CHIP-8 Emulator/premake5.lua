@@ -15,6 +15,7 @@ project "CHIP-8 Emulator"
 
 	filter "system:windows"
 		systemversion "latest"
+		defines { "_CRT_SECURE_NO_WARNINGS" }
 
 	filter "configurations:Debug"
 		runtime "Debug"
@@ -0,0 +1,102 @@
+#include "profile.h"
+#include "disassembler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static uint16_t opcode_at(const uint8_t* memory, uint16_t address)
+{
+	return (memory[address & 0xFFFu] << 8u) | memory[(address + 1u) & 0xFFFu];
+}
+
+void chip8_profile::clear()
+{
+	memset(per_opcode, 0, sizeof(per_opcode));
+	memset(per_address, 0, sizeof(per_address));
+	total = 0;
+}
+
+std::vector<hot_address> chip8_profile::hottest(uint32_t n) const
+{
+	std::vector<hot_address> hot;
+	for (uint16_t address = 0; address < 4096; address++)
+		if (per_address[address])
+			hot.push_back({ address, per_address[address] });
+
+	n = std::min<uint32_t>(n, (uint32_t)hot.size());
+	std::partial_sort(hot.begin(), hot.begin() + n, hot.end(),
+		[](const hot_address& a, const hot_address& b) { return a.count > b.count; });
+	hot.resize(n);
+	return hot;
+}
+
+bool chip8_profile::write_csv(const std::string& filepath, const uint8_t* memory) const
+{
+	FILE* file = fopen(filepath.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "address,opcode,instruction,count,percent\n");
+	for (uint16_t address = 0; address < 4096; address++)
+	{
+		if (!per_address[address])
+			continue;
+
+		uint16_t opcode = opcode_at(memory, address);
+		char text[DISASSEMBLY_LENGTH];
+		disassemble(opcode, text);
+		fprintf(file, "0x%03X,%04X,\"%s\",%llu,%.3f\n", address, opcode, text,
+			(unsigned long long)per_address[address], 100.0 * per_address[address] / total);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool chip8_profile::write_opcode_csv(const std::string& filepath) const
+{
+	FILE* file = fopen(filepath.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "instruction,count,percent\n");
+	for (uint32_t id = 0; id < (uint32_t)opcode_id::COUNT; id++)
+		if (per_opcode[id])
+			fprintf(file, "\"%s\",%llu,%.3f\n", instruction_names[id],
+				(unsigned long long)per_opcode[id], 100.0 * per_opcode[id] / total);
+
+	fclose(file);
+	return true;
+}
+
+bool chip8_profile::write_folded(const std::string& filepath, const std::string& root, const uint8_t* memory) const
+{
+	FILE* file = fopen(filepath.c_str(), "w");
+	if (!file)
+		return false;
+
+	// ';' separates the frames and the last space the count, neither can
+	// be part of a frame name
+	auto frame_name = [](std::string name)
+	{
+		if (name.empty())
+			return std::string("invalid");
+		std::replace(name.begin(), name.end(), ';', ':');
+		std::replace(name.begin(), name.end(), ' ', '_');
+		return name;
+	};
+
+	std::string rom = frame_name(root);
+	for (uint16_t address = 0; address < 4096; address++)
+	{
+		if (!per_address[address])
+			continue;
+
+		std::string instruction = frame_name(instruction_names[(uint32_t)decode(opcode_at(memory, address))]);
+		fprintf(file, "%s;%s;0x%03X %llu\n", rom.c_str(), instruction.c_str(), address, (unsigned long long)per_address[address]);
+	}
+
+	fclose(file);
+	return true;
+}
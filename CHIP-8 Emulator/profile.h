@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "decode.h"
+
+// Build with CHIP8_PROFILE=1 (premake5 --profile) to count every executed
+// instruction by opcode class and by address. Compiled out it costs nothing
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE 0
+#endif
+
+struct hot_address
+{
+	uint16_t address;
+	uint64_t count;
+};
+
+/*
+	Execution counts, filled in by chip8::cycle and chip8::run. The
+	instructions a superinstruction skips are counted at the addresses they
+	would have run at, so the numbers match plain cycle() calls.
+*/
+struct chip8_profile
+{
+public:
+	uint64_t per_opcode[(uint32_t)opcode_id::COUNT]{};
+	uint64_t per_address[4096]{};
+	uint64_t total = 0;
+
+	inline void count(uint16_t address, opcode_id id, uint64_t n = 1)
+	{
+		per_address[address & 0xFFFu] += n;
+		per_opcode[(uint32_t)id] += n;
+		total += n;
+	}
+
+	void clear();
+
+	// The `n` most executed addresses, most executed first
+	std::vector<hot_address> hottest(uint32_t n) const;
+
+	// address,opcode,instruction,count,percent for every address that ran,
+	// `memory` gives the opcodes
+	bool write_csv(const std::string& filepath, const uint8_t* memory) const;
+
+	// instruction,count,percent for every opcode class that ran
+	bool write_opcode_csv(const std::string& filepath) const;
+
+	// Collapsed stacks for flamegraph.pl and speedscope, one
+	// "<root>;<instruction>;<address> <count>" line per address
+	bool write_folded(const std::string& filepath, const std::string& root, const uint8_t* memory) const;
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+/*
+	xoshiro128** (Blackman and Vigna), the generator behind Cxkk. Four words
+	of state per instance instead of the hidden one behind rand(), so runs
+	repeat from a seed and instances on different threads don't share
+	anything. The state is passed by reference so chip8_lanes can keep one
+	per lane in its own arrays.
+*/
+inline uint32_t random_rotl(uint32_t x, uint32_t k)
+{
+	return (x << k) | (x >> (32u - k));
+}
+
+inline uint32_t random_next(uint32_t& s0, uint32_t& s1, uint32_t& s2, uint32_t& s3)
+{
+	uint32_t result = random_rotl(s1 * 5u, 7u) * 9u;
+	uint32_t t = s1 << 9u;
+
+	s2 ^= s0;
+	s3 ^= s1;
+	s1 ^= s2;
+	s0 ^= s3;
+	s2 ^= t;
+	s3 = random_rotl(s3, 11u);
+
+	return result;
+}
+
+// The top byte is the best one of the result
+inline uint8_t random_byte(uint32_t* state)
+{
+	return uint8_t(random_next(state[0], state[1], state[2], state[3]) >> 24u);
+}
+
+// Spreads a 64 bit seed over the state with splitmix64, any seed
+// (0 included) gives a state that isn't all zeros
+inline void random_seed(uint32_t* state, uint64_t seed)
+{
+	for (uint32_t i = 0; i < 4; i += 2)
+	{
+		seed += 0x9E3779B97F4A7C15ull;
+		uint64_t z = seed;
+		z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27u)) * 0x94D049BB133111EBull;
+		z ^= z >> 31u;
+		state[i] = uint32_t(z);
+		state[i + 1] = uint32_t(z >> 32u);
+	}
+}
@@ -0,0 +1,176 @@
+#include "rewind.h"
+
+#include <cstring>
+
+// registers, then I, pc, stack, sp, timers and keypad, then the Cxkk generator
+#define REGISTER_BYTES (STATE_MEMORY_OFFSET - STATE_REGISTERS_OFFSET)
+#define TAIL_BYTES (STATE_DISPLAY_OFFSET - STATE_CPU_OFFSET)
+#define RANDOM_BYTES (STATE_SIZE - STATE_RANDOM_OFFSET)
+#define CPU_BYTES (REGISTER_BYTES + TAIL_BYTES + RANDOM_BYTES)
+
+// chunk mask, row mask, cpu
+#define ENTRY_HEADER (8 + 4 + CPU_BYTES)
+
+rewind_ring::rewind_ring(size_t capacity)
+{
+	set_capacity(capacity);
+	scratch.reserve(ENTRY_HEADER + 4096 + SCREEN_HEIGHT * sizeof(uint64_t));
+}
+
+void rewind_ring::set_capacity(size_t capacity)
+{
+	ring.assign(capacity > STATE_SIZE ? capacity - STATE_SIZE : 0, 0);
+	clear();
+}
+
+void rewind_ring::clear()
+{
+	entries.clear();
+	first = 0;
+	used = 0;
+	has_head = false;
+}
+
+/*
+	Entry layout:
+		8       bit n set: memory chunk n follows
+		4       bit y set: display row y follows
+		CPU_BYTES
+		64 per chunk, 8 per row
+*/
+void rewind_ring::record(const chip8& interpreter)
+{
+	interpreter.save_state(current);
+
+	if (!has_head)
+	{
+		memcpy(head, current, STATE_SIZE);
+		has_head = true;
+		return;
+	}
+
+	uint64_t chunks = 0;
+	for (uint32_t c = 0; c < REWIND_CHUNKS; c++)
+	{
+		size_t at = STATE_MEMORY_OFFSET + c * REWIND_CHUNK;
+		if (memcmp(head + at, current + at, REWIND_CHUNK) != 0)
+			chunks |= 1ull << c;
+	}
+
+	uint32_t rows = 0;
+	for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
+	{
+		size_t at = STATE_DISPLAY_OFFSET + y * sizeof(uint64_t);
+		if (memcmp(head + at, current + at, sizeof(uint64_t)) != 0)
+			rows |= 1u << y;
+	}
+
+	scratch.resize(ENTRY_HEADER);
+	memcpy(scratch.data(), &chunks, 8);
+	memcpy(scratch.data() + 8, &rows, 4);
+	memcpy(scratch.data() + 12, head + STATE_REGISTERS_OFFSET, REGISTER_BYTES);
+	memcpy(scratch.data() + 12 + REGISTER_BYTES, head + STATE_CPU_OFFSET, TAIL_BYTES);
+	memcpy(scratch.data() + 12 + REGISTER_BYTES + TAIL_BYTES, head + STATE_RANDOM_OFFSET, RANDOM_BYTES);
+
+	for (uint32_t c = 0; c < REWIND_CHUNKS; c++)
+		if (chunks & (1ull << c))
+		{
+			const uint8_t* chunk = head + STATE_MEMORY_OFFSET + c * REWIND_CHUNK;
+			scratch.insert(scratch.end(), chunk, chunk + REWIND_CHUNK);
+		}
+	for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
+		if (rows & (1u << y))
+		{
+			const uint8_t* row = head + STATE_DISPLAY_OFFSET + y * sizeof(uint64_t);
+			scratch.insert(scratch.end(), row, row + sizeof(uint64_t));
+		}
+
+	push(scratch.data(), scratch.size());
+	memcpy(head, current, STATE_SIZE);
+}
+
+bool rewind_ring::step_back(chip8& interpreter)
+{
+	if (!has_head)
+		return false;
+
+	// the interpreter went on since the last record, that one comes first.
+	// The keypad belongs to whoever holds the keys, it doesn't count
+	interpreter.save_state(current);
+	if (memcmp(current, head, STATE_KEYPAD_OFFSET) != 0 ||
+		memcmp(current + STATE_DISPLAY_OFFSET, head + STATE_DISPLAY_OFFSET, STATE_SIZE - STATE_DISPLAY_OFFSET) != 0)
+		return interpreter.load_state(head, STATE_SIZE);
+
+	if (entries.empty())
+		return false;
+
+	pop_newest(scratch);
+	const uint8_t* in = scratch.data();
+
+	uint64_t chunks;
+	uint32_t rows;
+	memcpy(&chunks, in, 8);
+	memcpy(&rows, in + 8, 4);
+	in += 12;
+	memcpy(head + STATE_REGISTERS_OFFSET, in, REGISTER_BYTES);
+	in += REGISTER_BYTES;
+	memcpy(head + STATE_CPU_OFFSET, in, TAIL_BYTES);
+	in += TAIL_BYTES;
+	memcpy(head + STATE_RANDOM_OFFSET, in, RANDOM_BYTES);
+	in += RANDOM_BYTES;
+
+	for (uint32_t c = 0; c < REWIND_CHUNKS; c++)
+		if (chunks & (1ull << c))
+		{
+			memcpy(head + STATE_MEMORY_OFFSET + c * REWIND_CHUNK, in, REWIND_CHUNK);
+			in += REWIND_CHUNK;
+		}
+	for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
+		if (rows & (1u << y))
+		{
+			memcpy(head + STATE_DISPLAY_OFFSET + y * sizeof(uint64_t), in, sizeof(uint64_t));
+			in += sizeof(uint64_t);
+		}
+
+	return interpreter.load_state(head, STATE_SIZE);
+}
+
+// Appends at the end of the ring, wrapping around and dropping the
+// oldest entries until there is room
+void rewind_ring::push(const uint8_t* data, size_t size)
+{
+	if (size > ring.size())
+	{
+		entries.clear();
+		first = 0;
+		used = 0;
+		return;
+	}
+
+	while (ring.size() - used < size)
+	{
+		first = (first + entries.front().size) % ring.size();
+		used -= entries.front().size;
+		entries.pop_front();
+	}
+
+	size_t offset = (first + used) % ring.size();
+	size_t part = size < ring.size() - offset ? size : ring.size() - offset;
+	memcpy(ring.data() + offset, data, part);
+	memcpy(ring.data(), data + part, size - part);
+
+	entries.push_back({ offset, size });
+	used += size;
+}
+
+void rewind_ring::pop_newest(std::vector<uint8_t>& out)
+{
+	entry newest = entries.back();
+	entries.pop_back();
+	used -= newest.size;
+
+	out.resize(newest.size);
+	size_t part = newest.size < ring.size() - newest.offset ? newest.size : ring.size() - newest.offset;
+	memcpy(out.data(), ring.data() + newest.offset, part);
+	memcpy(out.data() + part, ring.data(), newest.size - part);
+}
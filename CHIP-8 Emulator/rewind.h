@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "chip8.h"
+#include "savestate.h"
+
+#define REWIND_CHUNK 64
+#define REWIND_CHUNKS (4096 / REWIND_CHUNK)
+
+/*
+	Bounded history for scrubbing backwards. `head` is the newest recorded
+	state in full, every entry in the ring is what it takes to go one
+	record back from the one after it: the cpu registers plus the 64 byte
+	chunks of memory and the display rows that were different, as they
+	were before. The ring's bytes are allocated once, when it is full the
+	oldest entries make room.
+*/
+struct rewind_ring
+{
+public:
+	rewind_ring(size_t capacity);
+
+	void record(const chip8& interpreter);
+
+	// Puts the interpreter back to the last recorded state, or the one
+	// before if it's already there. False when there is nothing older
+	bool step_back(chip8& interpreter);
+
+	void clear();
+
+	// drops everything
+	void set_capacity(size_t capacity);
+
+	// records that can be stepped back to
+	size_t states() const { return entries.size() + (has_head ? 1 : 0); }
+
+	// the ring and the full head state
+	size_t bytes() const { return used + STATE_SIZE; }
+	size_t capacity() const { return ring.size() + STATE_SIZE; }
+
+private:
+	struct entry
+	{
+		size_t offset;
+		size_t size;
+	};
+
+	std::vector<uint8_t> ring;
+	std::deque<entry> entries;
+	size_t first = 0;
+	size_t used = 0;
+
+	uint8_t head[STATE_SIZE];
+	bool has_head = false;
+
+	uint8_t current[STATE_SIZE];
+	std::vector<uint8_t> scratch;
+
+	void push(const uint8_t* data, size_t size);
+	void pop_newest(std::vector<uint8_t>& out);
+};
@@ -0,0 +1,138 @@
+#include "rom_database.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#define ROM_DATABASE_HEADER 16
+
+void rom_database::open(const std::string& filepath)
+{
+	file.close();
+	path = filepath;
+	mapped = false;
+	records = nullptr;
+	count = 0;
+	changed.clear();
+}
+
+void rom_database::map()
+{
+	mapped = true;
+	if (!file.open(path))
+		return;
+
+	const uint8_t* data = file.data();
+	uint32_t magic = 0, records_in_file = 0;
+	uint16_t version = 0, record_size = 0;
+	if (file.size() >= ROM_DATABASE_HEADER)
+	{
+		memcpy(&magic, data, 4);
+		memcpy(&version, data + 4, 2);
+		memcpy(&record_size, data + 6, 2);
+		memcpy(&records_in_file, data + 8, 4);
+	}
+
+	if (magic != ROM_DATABASE_MAGIC || version != ROM_DATABASE_VERSION || record_size != sizeof(rom_record) ||
+		ROM_DATABASE_HEADER + (uint64_t)records_in_file * sizeof(rom_record) > file.size())
+	{
+		std::cout << path << " isn't a rom database this version can read, starting a new one\n";
+		file.close();
+		return;
+	}
+
+	// the mapping is page aligned and the header keeps the records 8 byte aligned
+	records = (const rom_record*)(data + ROM_DATABASE_HEADER);
+	count = records_in_file;
+}
+
+const rom_record* rom_database::find(uint64_t hash, uint32_t size)
+{
+	if (!mapped)
+		map();
+
+	const rom_record* found = nullptr;
+	auto pending = changed.find(hash);
+	if (pending != changed.end())
+		found = &pending->second;
+	else
+	{
+		const rom_record* end = records + count;
+		const rom_record* at = std::lower_bound(records, end, hash,
+			[](const rom_record& record, uint64_t h) { return record.hash < h; });
+		if (at != end && at->hash == hash)
+			found = at;
+	}
+
+	if (!found || found->size != size || found->analysis_version != ROM_ANALYSIS_VERSION)
+		return nullptr;
+	return found;
+}
+
+const rom_record* rom_database::store(const rom_record& record)
+{
+	if (!mapped)
+		map();
+
+	rom_record& stored = changed[record.hash];
+	stored = record;
+	return &stored;
+}
+
+bool rom_database::save()
+{
+	if (changed.empty())
+		return true;
+	if (!mapped)
+		map();
+
+	std::vector<rom_record> all;
+	all.reserve(count + changed.size());
+	for (uint32_t i = 0; i < count; i++)
+		if (records[i].analysis_version == ROM_ANALYSIS_VERSION && changed.find(records[i].hash) == changed.end())
+			all.push_back(records[i]);
+	for (const auto& [hash, record] : changed)
+		all.push_back(record);
+	std::sort(all.begin(), all.end(), [](const rom_record& a, const rom_record& b) { return a.hash < b.hash; });
+
+	// written next to it first, a crash halfway leaves the old file alone
+	std::string temporary = path + ".tmp";
+	FILE* out = fopen(temporary.c_str(), "wb");
+	if (!out)
+		return false;
+
+	uint32_t magic = ROM_DATABASE_MAGIC;
+	uint16_t version = ROM_DATABASE_VERSION;
+	uint16_t record_size = sizeof(rom_record);
+	uint32_t records_in_file = (uint32_t)all.size();
+	uint32_t reserved = 0;
+	fwrite(&magic, 4, 1, out);
+	fwrite(&version, 2, 1, out);
+	fwrite(&record_size, 2, 1, out);
+	fwrite(&records_in_file, 4, 1, out);
+	fwrite(&reserved, 4, 1, out);
+	fwrite(all.data(), sizeof(rom_record), all.size(), out);
+	bool written = !ferror(out);
+	fclose(out);
+	if (!written)
+		return false;
+
+	// windows won't replace a file that is still mapped
+	file.close();
+	records = nullptr;
+	count = 0;
+	mapped = false;
+
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error)
+	{
+		std::cout << "can't replace " << path << ": " << error.message() << "\n";
+		return false;
+	}
+	changed.clear();
+	return true;
+}
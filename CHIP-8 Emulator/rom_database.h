@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "analysis.h"
+#include "mapped_file.h"
+
+// rom_record::flags
+#define ROM_RECORD_IPS 0x1 // ips holds the speed the rom was last played at
+
+/*
+	Everything worth remembering about a rom between runs, found by the
+	hash of its contents (rom_library::hash) and checked against its size.
+	Written to disk as it is.
+*/
+struct rom_record
+{
+	uint64_t hash;
+	uint32_t size;
+	uint32_t flags;
+	// instructions per second, 0 unlimited
+	uint32_t ips;
+	// none so far, the interpreter only has the one set of behaviours
+	uint32_t quirks;
+	rom_analysis analysis;
+	// ROM_ANALYSIS_VERSION `analysis` was made with, records made by
+	// another one are thrown away
+	uint32_t analysis_version;
+};
+static_assert(std::is_trivially_copyable_v<rom_record> && sizeof(rom_record) == 2720,
+	"rom records get written to disk as they are, without padding");
+
+/*
+	File layout:
+		4       magic "C8DB"
+		2       version
+		2       size of a record
+		4       number of records
+		4       reserved, 0
+		        records sorted by hash
+*/
+#define ROM_DATABASE_MAGIC 0x42443843u // "C8DB"
+#define ROM_DATABASE_VERSION 1
+
+/*
+	rom_records kept in a file that gets mapped on the first lookup and
+	searched where it is, so opening costs nothing and a lookup only
+	touches the pages it needs. New and changed records stay in memory
+	until save() writes everything back out.
+*/
+struct rom_database
+{
+public:
+	rom_database() = default;
+
+	rom_database(const rom_database&) = delete;
+	rom_database& operator=(const rom_database&) = delete;
+
+	// Only remembers the path, a missing file is an empty database
+	void open(const std::string& filepath);
+
+	// nullptr for a rom that was never stored or was stored with another
+	// ROM_ANALYSIS_VERSION. Stays valid until the next store() of the
+	// same rom or save()
+	const rom_record* find(uint64_t hash, uint32_t size);
+
+	// Adds the record or replaces the one with the same hash
+	const rom_record* store(const rom_record& record);
+
+	// Writes the file again when something changed
+	bool save();
+
+	// records that were in the file, 0 before the first lookup
+	uint32_t stored() const { return count; }
+
+private:
+	std::string path;
+	bool mapped = false;
+	mapped_file file;
+	const rom_record* records = nullptr;
+	uint32_t count = 0;
+	std::unordered_map<uint64_t, rom_record> changed;
+
+	void map();
+};
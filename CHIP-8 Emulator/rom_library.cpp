@@ -0,0 +1,213 @@
+#include "rom_library.h"
+#include "chip8.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+
+#define ROM_ARCHIVE_HEADER 16
+#define ROM_ARCHIVE_ENTRY 24
+
+rom_library::~rom_library()
+{
+	close();
+}
+
+bool rom_library::open(const std::string& path)
+{
+	close();
+
+	bool opened = std::filesystem::is_directory(path) ? open_folder(path) : open_archive(path);
+	if (opened)
+		build_index();
+	return opened;
+}
+
+void rom_library::close()
+{
+	roms.clear();
+	by_name.clear();
+	by_hash.clear();
+	contents.clear();
+	skipped = 0;
+	base = nullptr;
+	archive.close();
+}
+
+uint64_t rom_library::hash(const uint8_t* data, size_t size)
+{
+	uint64_t h = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ data[i]) * 0x100000001B3ull;
+	return h;
+}
+
+// Reads every file into one buffer, each one only once
+bool rom_library::open_folder(const std::string& path)
+{
+	std::error_code error;
+	for (const auto& file : std::filesystem::directory_iterator(path, error))
+	{
+		if (!file.is_regular_file())
+			continue;
+
+		uintmax_t size = file.file_size(error);
+		if (error || size == 0 || size > PROGRAM_SIZE)
+		{
+			std::cout << "skipping " << file.path().string() << ", doesn't fit in program memory\n";
+			skipped++;
+			continue;
+		}
+
+		FILE* handle = fopen(file.path().string().c_str(), "rb");
+		if (!handle)
+		{
+			skipped++;
+			continue;
+		}
+
+		size_t offset = contents.size();
+		contents.resize(offset + size);
+		size_t read = fread(contents.data() + offset, 1, size, handle);
+		fclose(handle);
+		if (read != size)
+		{
+			contents.resize(offset);
+			skipped++;
+			continue;
+		}
+
+		roms.push_back({ file.path().filename().string(), hash(contents.data() + offset, size), (uint32_t)offset, (uint16_t)size });
+	}
+
+	if (error)
+		return false;
+
+	base = contents.data();
+	std::sort(roms.begin(), roms.end(), [](const rom_entry& a, const rom_entry& b) { return a.name < b.name; });
+	return true;
+}
+
+bool rom_library::open_archive(const std::string& filepath)
+{
+	if (!archive.open(filepath) || archive.size() < ROM_ARCHIVE_HEADER)
+	{
+		archive.close();
+		return false;
+	}
+
+	base = archive.data();
+
+	uint32_t magic, count;
+	uint16_t version;
+	memcpy(&magic, base, 4);
+	memcpy(&version, base + 4, 2);
+	memcpy(&count, base + 8, 4);
+	if (magic != ROM_ARCHIVE_MAGIC || version != ROM_ARCHIVE_VERSION ||
+		ROM_ARCHIVE_HEADER + (uint64_t)count * ROM_ARCHIVE_ENTRY > archive.size())
+	{
+		std::cout << filepath << " isn't a rom archive\n";
+		close();
+		return false;
+	}
+
+	// only the table gets read now, the contents stay where they are
+	// until a rom gets loaded
+	roms.reserve(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint8_t* entry = base + ROM_ARCHIVE_HEADER + (size_t)i * ROM_ARCHIVE_ENTRY;
+		rom_entry rom;
+		uint32_t name_offset;
+		uint16_t name_length;
+		memcpy(&rom.hash, entry, 8);
+		memcpy(&rom.offset, entry + 8, 4);
+		memcpy(&name_offset, entry + 12, 4);
+		memcpy(&rom.size, entry + 16, 2);
+		memcpy(&name_length, entry + 18, 2);
+
+		if (rom.size == 0 || rom.size > PROGRAM_SIZE || (uint64_t)rom.offset + rom.size > archive.size() ||
+			(uint64_t)name_offset + name_length > archive.size())
+		{
+			skipped++;
+			continue;
+		}
+
+		rom.name.assign((const char*)base + name_offset, name_length);
+		roms.push_back(std::move(rom));
+	}
+	return true;
+}
+
+void rom_library::build_index()
+{
+	by_name.reserve(roms.size());
+	by_hash.reserve(roms.size());
+	for (uint32_t i = 0; i < roms.size(); i++)
+	{
+		by_name.emplace(roms[i].name, i);
+		by_hash.emplace(roms[i].hash, i);
+	}
+}
+
+int64_t rom_library::find(std::string_view name) const
+{
+	auto found = by_name.find(name);
+	return found == by_name.end() ? -1 : found->second;
+}
+
+int64_t rom_library::find(uint64_t hash) const
+{
+	auto found = by_hash.find(hash);
+	return found == by_hash.end() ? -1 : found->second;
+}
+
+bool rom_library::write_archive(const std::string& filepath) const
+{
+	FILE* file = fopen(filepath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	uint32_t count = (uint32_t)roms.size();
+	uint32_t names_offset = ROM_ARCHIVE_HEADER + count * ROM_ARCHIVE_ENTRY;
+	uint32_t names_size = 0;
+	for (const rom_entry& rom : roms)
+		names_size += (uint32_t)rom.name.size();
+
+	uint32_t magic = ROM_ARCHIVE_MAGIC;
+	uint16_t version = ROM_ARCHIVE_VERSION;
+	uint16_t reserved16 = 0;
+	uint32_t reserved32 = 0;
+	fwrite(&magic, 4, 1, file);
+	fwrite(&version, 2, 1, file);
+	fwrite(&reserved16, 2, 1, file);
+	fwrite(&count, 4, 1, file);
+	fwrite(&reserved32, 4, 1, file);
+
+	uint32_t name_offset = names_offset;
+	uint32_t data_offset = names_offset + names_size;
+	for (const rom_entry& rom : roms)
+	{
+		uint16_t name_length = (uint16_t)rom.name.size();
+		fwrite(&rom.hash, 8, 1, file);
+		fwrite(&data_offset, 4, 1, file);
+		fwrite(&name_offset, 4, 1, file);
+		fwrite(&rom.size, 2, 1, file);
+		fwrite(&name_length, 2, 1, file);
+		fwrite(&reserved32, 4, 1, file);
+		name_offset += name_length;
+		data_offset += rom.size;
+	}
+
+	for (const rom_entry& rom : roms)
+		fwrite(rom.name.data(), 1, rom.name.size(), file);
+	for (const rom_entry& rom : roms)
+		fwrite(data(rom), 1, rom.size, file);
+
+	bool written = !ferror(file);
+	fclose(file);
+	return written;
+}
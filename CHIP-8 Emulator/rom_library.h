@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+/*
+	Every ROM of a folder or of a packed archive, loaded once. A folder
+	gets read into one block of memory, an archive gets mapped as it is,
+	so switching games is a copy out of memory that is already there.
+	ROMs are sorted by name and can also be found by the FNV-1a hash of
+	their contents. Empty files and files that don't fit in the 0xE00
+	bytes of program memory are left out.
+
+	Archive layout (write_archive), offsets from the start of the file:
+		4       magic "C8RA"
+		2       version
+		2       reserved, 0
+		4       number of roms
+		4       reserved, 0
+		        one 24 byte entry per rom, sorted by name:
+		8           hash of the contents
+		4           offset of the contents
+		4           offset of the name
+		2           size of the contents
+		2           length of the name
+		4           reserved, 0
+		        names and contents
+*/
+#define ROM_ARCHIVE_MAGIC 0x41523843u // "C8RA"
+#define ROM_ARCHIVE_VERSION 1
+#define ROM_ARCHIVE_EXTENSION ".c8ra"
+
+struct rom_entry
+{
+	std::string name;
+	uint64_t hash;
+	uint32_t offset;
+	uint16_t size;
+};
+
+struct rom_library
+{
+public:
+	rom_library() = default;
+	~rom_library();
+
+	rom_library(const rom_library&) = delete;
+	rom_library& operator=(const rom_library&) = delete;
+
+	// A folder or an archive, whatever was open before gets closed
+	bool open(const std::string& path);
+	void close();
+
+	bool write_archive(const std::string& filepath) const;
+
+	size_t size() const { return roms.size(); }
+	const rom_entry& operator[](size_t index) const { return roms[index]; }
+	const uint8_t* data(const rom_entry& rom) const { return base + rom.offset; }
+
+	// index of the rom, -1 when there is none
+	int64_t find(std::string_view name) const;
+	int64_t find(uint64_t hash) const;
+
+	// files that were left out when opening a folder, or broken entries
+	// of an archive
+	size_t rejected() const { return skipped; }
+
+	static uint64_t hash(const uint8_t* data, size_t size);
+
+private:
+	std::vector<rom_entry> roms;
+	std::unordered_map<std::string_view, uint32_t> by_name;
+	std::unordered_map<uint64_t, uint32_t> by_hash;
+	size_t skipped = 0;
+
+	// points into `contents` for a folder and into `archive` for an archive
+	const uint8_t* base = nullptr;
+	std::vector<uint8_t> contents;
+
+	mapped_file archive;
+
+	bool open_folder(const std::string& path);
+	bool open_archive(const std::string& filepath);
+	void build_index();
+};
@@ -0,0 +1,248 @@
+#include "savestate.h"
+
+#include <cstring>
+
+#define STATE_PAYLOAD_SIZE (STATE_SIZE - STATE_HEADER_SIZE)
+
+// payload size of each version, 0 isn't one
+static const uint32_t payload_sizes[STATE_VERSION + 1] = { 0, STATE_V1_SIZE - STATE_HEADER_SIZE, STATE_PAYLOAD_SIZE };
+
+// a zero run shorter than this stays part of the literal around it
+#define MIN_ZERO_RUN 4
+
+static_assert(STATE_HEADER_SIZE + 16 + 4096 + 2 + 2 + 32 + 1 + 1 + 1 + 16 + 256 + 16 == STATE_SIZE);
+static_assert(STATE_MEMORY_OFFSET + 4096 == STATE_CPU_OFFSET && STATE_DISPLAY_OFFSET + 256 == STATE_RANDOM_OFFSET);
+static_assert(STATE_RANDOM_OFFSET == STATE_V1_SIZE && STATE_RANDOM_OFFSET + 16 == STATE_SIZE);
+
+size_t chip8::save_state(uint8_t* buffer) const
+{
+	uint32_t magic = STATE_MAGIC;
+	uint16_t version = STATE_VERSION;
+	uint16_t reserved = 0;
+	uint32_t payload = STATE_PAYLOAD_SIZE;
+
+	uint8_t* out = buffer;
+	auto put = [&](const void* value, size_t size)
+	{
+		memcpy(out, value, size);
+		out += size;
+	};
+
+	put(&magic, 4);
+	put(&version, 2);
+	put(&reserved, 2);
+	put(&payload, 4);
+	put(registers, sizeof(registers));
+	put(memory, sizeof(memory));
+	put(&index, 2);
+	put(&pc, 2);
+	put(stack, sizeof(stack));
+	put(&stack_pointer, 1);
+	put(&delay_timer, 1);
+	put(&sound_timer, 1);
+	put(keypad, sizeof(keypad));
+	put(display, sizeof(display));
+	put(random_state, sizeof(random_state));
+
+	return out - buffer;
+}
+
+/*
+	Only the 64 byte chunks of memory that actually differ get copied and
+	drop their decoded instructions, restoring a state close to the current
+	one leaves the instruction cache (and the JIT's blocks) mostly alone.
+*/
+bool chip8::load_state(const uint8_t* buffer, size_t size)
+{
+	uint32_t magic, payload;
+	uint16_t version;
+	if (size < STATE_HEADER_SIZE)
+		return false;
+
+	memcpy(&magic, buffer, 4);
+	memcpy(&version, buffer + 4, 2);
+	memcpy(&payload, buffer + 8, 4);
+	if (magic != STATE_MAGIC || version == 0 || version > STATE_VERSION ||
+		payload != payload_sizes[version] || size != STATE_HEADER_SIZE + payload)
+		return false;
+
+	const uint8_t* in = buffer + STATE_HEADER_SIZE;
+	auto get = [&](void* value, size_t size)
+	{
+		memcpy(value, in, size);
+		in += size;
+	};
+
+	get(registers, sizeof(registers));
+
+	for (uint32_t chunk = 0; chunk < sizeof(memory); chunk += 64)
+		if (memcmp(memory + chunk, in + chunk, 64) != 0)
+		{
+			memcpy(memory + chunk, in + chunk, 64);
+			invalidate(chunk, 64);
+		}
+	in += sizeof(memory);
+
+	get(&index, 2);
+	get(&pc, 2);
+	get(stack, sizeof(stack));
+	get(&stack_pointer, 1);
+	get(&delay_timer, 1);
+	get(&sound_timer, 1);
+	get(keypad, sizeof(keypad));
+
+	uint32_t changed = 0;
+	for (uint32_t y = 0; y < SCREEN_HEIGHT; y++)
+	{
+		uint64_t row;
+		memcpy(&row, in + y * sizeof(uint64_t), sizeof(uint64_t));
+		if (row != display[y])
+			changed |= 1u << y;
+		display[y] = row;
+	}
+
+	if (changed)
+	{
+		dirty_rows |= changed;
+		display_generation++;
+	}
+	in += sizeof(display);
+
+	if (version >= 2)
+		get(random_state, sizeof(random_state));
+	return true;
+}
+
+static void put_varint(std::vector<uint8_t>& out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(uint8_t(value) | 0x80u);
+		value >>= 7u;
+	}
+	out.push_back(uint8_t(value));
+}
+
+static bool get_varint(const uint8_t*& in, const uint8_t* end, size_t& value)
+{
+	value = 0;
+	for (uint32_t shift = 0; in < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *in++;
+		value |= size_t(byte & 0x7Fu) << shift;
+		if (!(byte & 0x80u))
+			return true;
+	}
+	return false;
+}
+
+void encode_delta(const uint8_t* state, const uint8_t* base, size_t size, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+		// equal bytes, 8 at a time while it lasts
+		size_t zeros = i;
+		while (zeros + 8 <= size)
+		{
+			uint64_t a, b;
+			memcpy(&a, state + zeros, 8);
+			memcpy(&b, base + zeros, 8);
+			if (a != b)
+				break;
+			zeros += 8;
+		}
+		while (zeros < size && state[zeros] == base[zeros])
+			zeros++;
+
+		if (zeros == size)
+			break;
+
+		// the literal goes on until MIN_ZERO_RUN equal bytes in a row
+		size_t end = zeros;
+		size_t equal = 0;
+		while (end < size && equal < MIN_ZERO_RUN)
+		{
+			equal = state[end] == base[end] ? equal + 1 : 0;
+			end++;
+		}
+		if (equal == MIN_ZERO_RUN)
+			end -= equal;
+		else
+			while (end > zeros && state[end - 1] == base[end - 1])
+				end--;
+
+		put_varint(out, zeros - i);
+		put_varint(out, end - zeros);
+		for (size_t k = zeros; k < end; k++)
+			out.push_back(state[k] ^ base[k]);
+		i = end;
+	}
+}
+
+bool apply_delta(uint8_t* state, size_t size, const uint8_t* delta, size_t length)
+{
+	const uint8_t* in = delta;
+	const uint8_t* end = delta + length;
+	size_t i = 0;
+	while (in < end)
+	{
+		size_t zeros, literal;
+		if (!get_varint(in, end, zeros) || !get_varint(in, end, literal))
+			return false;
+		if (zeros > size - i || literal > size - i - zeros || literal > size_t(end - in))
+			return false;
+
+		i += zeros;
+		for (size_t k = 0; k < literal; k++)
+			state[i + k] ^= in[k];
+		in += literal;
+		i += literal;
+	}
+	return true;
+}
+
+void state_history::push(const chip8& interpreter)
+{
+	interpreter.save_state(scratch);
+
+	if (!keyframes.empty() && since_keyframe < keyframe_interval)
+	{
+		size_t offset = deltas.size();
+		encode_delta(scratch, keyframes.back().data(), STATE_SIZE, deltas);
+		size_t length = deltas.size() - offset;
+
+		if (length <= STATE_SIZE / 4)
+		{
+			snapshots.push_back({ uint32_t(keyframes.size() - 1), uint32_t(offset), uint32_t(length) });
+			since_keyframe++;
+			return;
+		}
+		deltas.resize(offset);
+	}
+
+	// the keyframe is its own snapshot, with an empty delta
+	keyframes.emplace_back(scratch, scratch + STATE_SIZE);
+	snapshots.push_back({ uint32_t(keyframes.size() - 1), uint32_t(deltas.size()), 0 });
+	since_keyframe = 0;
+}
+
+bool state_history::restore(size_t snapshot, chip8& interpreter)
+{
+	if (snapshot >= snapshots.size())
+		return false;
+
+	const snapshot_entry& entry = snapshots[snapshot];
+	memcpy(scratch, keyframes[entry.keyframe].data(), STATE_SIZE);
+	if (!apply_delta(scratch, STATE_SIZE, deltas.data() + entry.offset, entry.length))
+		return false;
+	return interpreter.load_state(scratch, STATE_SIZE);
+}
+
+void state_history::clear()
+{
+	keyframes.clear();
+	deltas.clear();
+	snapshots.clear();
+	since_keyframe = 0;
+}
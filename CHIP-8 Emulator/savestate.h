@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.h"
+
+/*
+	Save state format, version 2. Multi-byte values are in host byte order
+	(little endian on everything this builds for).
+
+		offset  size
+		0       4     magic "C8ST"
+		4       2     version
+		6       2     reserved, 0
+		8       4     payload size
+		12      16    registers V0 - VF
+		28      4096  memory
+		4124    2     index
+		4126    2     pc
+		4128    32    stack
+		4160    1     stack pointer
+		4161    1     delay timer
+		4162    1     sound timer
+		4163    16    keypad
+		4179    256   display rows
+		4435    16    Cxkk generator state (version 2)
+
+	A new version only ever appends, load_state still reads older ones
+	(leaving what they don't have alone) and refuses versions it doesn't
+	know and sizes that don't match.
+*/
+#define STATE_MAGIC 0x54533843u // "C8ST"
+#define STATE_VERSION 2
+#define STATE_HEADER_SIZE 12
+#define STATE_SIZE 4451
+#define STATE_V1_SIZE 4435
+
+// where the parts that get big start, for code that diffs states
+#define STATE_REGISTERS_OFFSET 12
+#define STATE_MEMORY_OFFSET 28
+#define STATE_CPU_OFFSET 4124
+#define STATE_KEYPAD_OFFSET 4163
+#define STATE_DISPLAY_OFFSET 4179
+#define STATE_RANDOM_OFFSET 4435
+
+/*
+	A run of snapshots of one instance. Every snapshot is stored as the
+	XOR against the last keyframe with the runs of zeros squeezed out, so
+	it only costs the bytes that changed. Getting any snapshot back takes
+	the keyframe and one delta, never a chain of them.
+
+	Delta encoding: pairs of <zero bytes> <literal bytes>, both as LEB128
+	varints, each followed by that many literal bytes.
+*/
+struct state_history
+{
+public:
+	// snapshots per keyframe at most, a delta that grows past a quarter
+	// of a full state starts a new keyframe sooner
+	uint32_t keyframe_interval = 256;
+
+	void push(const chip8& interpreter);
+
+	// 0 is the oldest snapshot
+	bool restore(size_t snapshot, chip8& interpreter);
+
+	void clear();
+
+	size_t size() const { return snapshots.size(); }
+
+	// bytes taken by keyframes and deltas
+	size_t bytes() const { return keyframes.size() * STATE_SIZE + deltas.size(); }
+
+private:
+	struct snapshot_entry
+	{
+		uint32_t keyframe;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	std::vector<std::vector<uint8_t>> keyframes;
+	std::vector<uint8_t> deltas;
+	std::vector<snapshot_entry> snapshots;
+	uint32_t since_keyframe = 0;
+
+	uint8_t scratch[STATE_SIZE];
+};
+
+// XOR of `state` and `base` as zero runs and literals, appended to `out`
+void encode_delta(const uint8_t* state, const uint8_t* base, size_t size, std::vector<uint8_t>& out);
+
+// XORs a delta made by encode_delta into `state`
+bool apply_delta(uint8_t* state, size_t size, const uint8_t* delta, size_t length);
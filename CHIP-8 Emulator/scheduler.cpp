@@ -0,0 +1,104 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+// instructions run() gets at once in unlimited mode between clock checks
+#define UNLIMITED_BATCH 20000
+
+bool scheduler::advance(chip8& interpreter, float dt)
+{
+	if (dt > max_catch_up)
+		dt = max_catch_up;
+
+	if (instructions_per_second)
+	{
+		pending_instructions += double(dt) * instructions_per_second;
+		uint64_t count = uint64_t(pending_instructions);
+		pending_instructions -= count;
+
+		uint64_t tail = tail_trace ? std::min<uint64_t>(count, traced_tail) : 0;
+		run_instructions(interpreter, count - tail);
+		if (tail)
+		{
+			interpreter.trace = tail_trace;
+			run_instructions(interpreter, tail);
+			interpreter.trace = nullptr;
+		}
+	}
+	else
+		run_unlimited(interpreter, dt);
+
+	const double refresh_period = 1.0 / REFRESH_RATE;
+	refresh_time += dt;
+	if (refresh_time < refresh_period)
+		return false;
+
+	// missed refreshes aren't made up for, one frame shows the latest state
+	refresh_time -= refresh_period;
+	if (refresh_time >= refresh_period)
+		refresh_time = 0.0;
+	return true;
+}
+
+void scheduler::reset()
+{
+	pending_instructions = 0.0;
+	refresh_time = 0.0;
+	tick_progress = 0;
+	timer_time = 0.0;
+}
+
+// Runs up to the next timer tick, ticks, and goes on until `count` is used up
+void scheduler::run_instructions(chip8& interpreter, uint64_t count)
+{
+	// until_tick would be 0 forever and the tick loop below never ends
+	if (!instructions_per_second)
+	{
+		interpreter.run(count);
+		executed += count;
+		return;
+	}
+
+	while (count > 0)
+	{
+		uint64_t until_tick = tick_progress < instructions_per_second ?
+			(instructions_per_second - tick_progress + TIMER_FREQUENCY - 1) / TIMER_FREQUENCY : 0;
+
+		uint64_t batch = until_tick < count ? until_tick : count;
+		interpreter.run(batch);
+		executed += batch;
+		count -= batch;
+		tick_progress += batch * TIMER_FREQUENCY;
+
+		while (tick_progress >= instructions_per_second)
+		{
+			interpreter.tick_timers();
+			if (log)
+				log->tick(executed);
+			ticks++;
+			tick_progress -= instructions_per_second;
+		}
+	}
+}
+
+void scheduler::run_unlimited(chip8& interpreter, float dt)
+{
+	const double tick_period = 1.0 / TIMER_FREQUENCY;
+	timer_time += dt;
+	while (timer_time >= tick_period)
+	{
+		interpreter.tick_timers();
+		if (log)
+			log->tick(executed);
+		ticks++;
+		timer_time -= tick_period;
+	}
+
+	auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(1.0 / REFRESH_RATE);
+	do
+	{
+		interpreter.run(UNLIMITED_BATCH);
+		executed += UNLIMITED_BATCH;
+	} while (std::chrono::steady_clock::now() < end);
+}
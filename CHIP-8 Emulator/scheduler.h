@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+
+#include "chip8.h"
+#include "input_log.h"
+
+#define TIMER_FREQUENCY 60
+#define REFRESH_RATE 60
+
+/*
+	Turns the time that passed between two updates into instructions,
+	timer ticks and frames.
+	With a fixed rate the timers tick once every instructions_per_second / 60
+	instructions, so a run only depends on how many instructions were
+	executed and not on how the frame times fell. Unlimited runs the cpu for
+	one refresh worth of real time per update and ticks the timers from dt.
+*/
+struct scheduler
+{
+public:
+	// 0 means unlimited
+	uint32_t instructions_per_second = 700;
+
+	// after a stall at most this many seconds get caught up, the rest is dropped
+	float max_catch_up = 0.25f;
+
+	// gets every timer tick when set, stamped with executed_instructions()
+	input_log* log = nullptr;
+
+	// fixed rate: when set, the last traced_tail instructions of every
+	// advance() run with it attached as chip8::trace and the rest run
+	// untraced, through run()'s fast path. Keeps the newest instructions
+	// in the ring without tracing all of them
+	trace_ring* tail_trace = nullptr;
+	uint32_t traced_tail = 0;
+
+	// Runs the interpreter for `dt` seconds, returns true when a frame
+	// should be presented, which is at most once per display refresh
+	bool advance(chip8& interpreter, float dt);
+
+	// Forgets the time that wasn't used up yet, for when a new rom gets loaded
+	void reset();
+
+	// Executes exactly `count` instructions at the fixed rate, ticking the
+	// timers on the way. For callers that count instructions instead of time.
+	// Needs instructions_per_second above 0, unlimited has no rate to tick
+	// the timers at and the instructions run without any ticks
+	void run_instructions(chip8& interpreter, uint64_t count);
+
+	uint64_t executed_instructions() { return executed; }
+	uint64_t timer_ticks() { return ticks; }
+
+private:
+	// fractions of an instruction and of a refresh left from earlier updates
+	double pending_instructions = 0.0;
+	double refresh_time = 0.0;
+
+	// fixed rate: goes up by TIMER_FREQUENCY for every instruction, the
+	// timers tick when it reaches instructions_per_second
+	uint64_t tick_progress = 0;
+
+	// unlimited: seconds since the last timer tick
+	double timer_time = 0.0;
+
+	uint64_t executed = 0;
+	uint64_t ticks = 0;
+
+	void run_unlimited(chip8& interpreter, float dt);
+};
@@ -0,0 +1,179 @@
+#include "trace.h"
+#include "chip8.h"
+#include "disassembler.h"
+
+#include <chrono>
+
+// how often the writer looks for new records while streaming
+#define TRACE_WRITE_INTERVAL std::chrono::milliseconds(5)
+
+trace_ring::trace_ring(uint32_t capacity)
+{
+	uint32_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	records.resize(size);
+	mask = size - 1;
+}
+
+trace_ring::~trace_ring()
+{
+	stop_streaming();
+}
+
+uint32_t trace_ring::latest(trace_record* out, uint32_t count) const
+{
+	uint64_t end = written.load(std::memory_order_relaxed);
+	uint64_t available = end < records.size() ? end : records.size();
+	if (count > available)
+		count = (uint32_t)available;
+
+	for (uint32_t i = 0; i < count; i++)
+		out[i] = records[(end - count + i) & mask];
+	return count;
+}
+
+bool trace_ring::start_streaming(const std::string& filepath)
+{
+	stop_streaming();
+
+	FILE* file = fopen(filepath.c_str(), "wb");
+	if (!file)
+		return false;
+
+	uint32_t magic = TRACE_MAGIC;
+	uint16_t version = TRACE_VERSION;
+	uint16_t record_size = sizeof(trace_record);
+	fwrite(&magic, sizeof(magic), 1, file);
+	fwrite(&version, sizeof(version), 1, file);
+	fwrite(&record_size, sizeof(record_size), 1, file);
+
+	stop_writer.store(false);
+	lost.store(0);
+	writer = std::thread(&trace_ring::write_loop, this, file, written.load(std::memory_order_acquire));
+	return true;
+}
+
+void trace_ring::stop_streaming()
+{
+	if (!writer.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(wake_lock);
+		stop_writer.store(true);
+	}
+	wake.notify_one();
+	writer.join();
+}
+
+/*
+	Copies what got committed since last time, then checks how far the
+	emulation went meanwhile: every record it could have started writing
+	over during the copy is thrown away instead of written half changed.
+	Whatever is left after stop_streaming() gets written before the file
+	is closed.
+*/
+void trace_ring::write_loop(FILE* file, uint64_t from)
+{
+	uint64_t size = records.size();
+	uint64_t done = from;
+	std::vector<trace_record> chunk;
+
+	while (true)
+	{
+		bool stopping = stop_writer.load();
+
+		uint64_t end = written.load(std::memory_order_acquire);
+		if (end - done > size)
+		{
+			lost.fetch_add(end - size - done, std::memory_order_relaxed);
+			done = end - size;
+		}
+
+		chunk.resize(end - done);
+		for (uint64_t i = done; i < end; i++)
+			chunk[i - done] = records[i & mask];
+
+		// the record after the last committed one is the one being written.
+		// The fence keeps the plain copies above from moving past this load
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = written.load(std::memory_order_relaxed);
+		uint64_t valid_from = after + 1 > size ? after + 1 - size : 0;
+		uint64_t torn = valid_from > done ? valid_from - done : 0;
+		if (torn > chunk.size())
+			torn = chunk.size();
+
+		lost.fetch_add(torn, std::memory_order_relaxed);
+		fwrite(chunk.data() + torn, sizeof(trace_record), chunk.size() - torn, file);
+		done = end;
+
+		if (stopping)
+			break;
+
+		std::unique_lock<std::mutex> lock(wake_lock);
+		wake.wait_for(lock, TRACE_WRITE_INTERVAL, [this] { return stop_writer.load(); });
+	}
+
+	fclose(file);
+}
+
+std::string trace_ring::format(const trace_record& record)
+{
+	char text[DISASSEMBLY_LENGTH];
+	disassemble(record.opcode, text);
+
+	char line[80];
+	int length = snprintf(line, sizeof(line), "%08X %03X %04X %-14s I=%03X", record.cycle, record.pc,
+		record.opcode, text, record.index);
+	if (record.reg != TRACE_NO_REGISTER)
+		snprintf(line + length, sizeof(line) - length, " V%X=%02X", record.reg, record.value);
+	return line;
+}
+
+bool trace_ring::print_file(const std::string& filepath, FILE* out)
+{
+	FILE* file = fopen(filepath.c_str(), "rb");
+	if (!file)
+		return false;
+
+	uint32_t magic = 0;
+	uint16_t version = 0, record_size = 0;
+	fread(&magic, sizeof(magic), 1, file);
+	fread(&version, sizeof(version), 1, file);
+	fread(&record_size, sizeof(record_size), 1, file);
+	if (magic != TRACE_MAGIC || version != TRACE_VERSION || record_size != sizeof(trace_record))
+	{
+		fclose(file);
+		return false;
+	}
+
+	trace_record records[256];
+	size_t count;
+	while ((count = fread(records, sizeof(trace_record), 256, file)) > 0)
+		for (size_t i = 0; i < count; i++)
+			fprintf(out, "%s\n", format(records[i]).c_str());
+
+	fclose(file);
+	return true;
+}
+
+// One instruction at a time through cycle(), so superinstructions show up
+// as the instructions they are made of
+void chip8::run_traced(uint64_t cycles)
+{
+	for (uint64_t i = 0; i < cycles; i++)
+	{
+		trace_record& record = trace->next();
+		record.pc = pc;
+		record.opcode = (memory[pc & 0xFFFu] << 8u) | memory[(pc + 1u) & 0xFFFu];
+
+		cycle();
+
+		record.index = index;
+		record.reg = written_register(decode_instruction(record.opcode));
+		record.value = record.reg == TRACE_NO_REGISTER ? 0 : registers[record.reg];
+		trace->commit();
+	}
+}
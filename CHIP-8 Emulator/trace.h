@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "decode.h"
+
+// 2^n records, 12 bytes each
+#define TRACE_CAPACITY (1u << 16)
+
+#define TRACE_NO_REGISTER 0xFF
+
+/*
+	One executed instruction, written as is and only turned into text when
+	somebody looks at it. `cycle` is the low half of the number of
+	instructions traced before it, `reg` the register the instruction
+	writes (TRACE_NO_REGISTER for none) and `value` what it holds after.
+	Index is I after the instruction.
+*/
+struct trace_record
+{
+	uint32_t cycle;
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t index;
+	uint8_t reg;
+	uint8_t value;
+};
+static_assert(sizeof(trace_record) == 12, "trace records get written to disk as they are");
+
+/*
+	Streamed trace file:
+		4       magic "C8TR"
+		2       version
+		2       size of a record
+		        records, oldest first. When the writer fell behind the
+		        emulation some are missing, the cycle numbers show where
+*/
+#define TRACE_MAGIC 0x52543843u // "C8TR"
+#define TRACE_VERSION 1
+
+/*
+	The last TRACE_CAPACITY instructions of a chip8 that has it attached
+	(chip8::trace). Only the emulation thread pushes, so writing a record
+	is a store and a counter bump.
+	While streaming a background thread copies the records to a file. The
+	emulation never waits for it: when the writer is more than the whole
+	ring behind, the records it missed are dropped and counted.
+*/
+struct trace_ring
+{
+public:
+	trace_ring(uint32_t capacity = TRACE_CAPACITY);
+	~trace_ring();
+
+	trace_ring(const trace_ring&) = delete;
+	trace_ring& operator=(const trace_ring&) = delete;
+
+	inline trace_record& next()
+	{
+		uint64_t at = written.load(std::memory_order_relaxed);
+		trace_record& record = records[at & mask];
+		record.cycle = (uint32_t)at;
+		return record;
+	}
+
+	// makes the record from next() visible to the writer thread
+	inline void commit()
+	{
+		written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Copies up to `count` of the newest records into `out`, oldest
+	// first. Returns how many there were
+	uint32_t latest(trace_record* out, uint32_t count) const;
+
+	uint64_t total() const { return written.load(std::memory_order_relaxed); }
+
+	// Appends everything pushed from now on to `filepath` on a background
+	// thread, see the file layout above
+	bool start_streaming(const std::string& filepath);
+	void stop_streaming();
+	bool streaming() const { return writer.joinable(); }
+
+	// records the writer couldn't keep up with, since streaming started
+	uint64_t dropped() const { return lost.load(std::memory_order_relaxed); }
+
+	// "<cycle> <pc> <opcode> <instruction>  I=<index> V<reg>=<value>"
+	static std::string format(const trace_record& record);
+
+	// Writes a streamed file as text, one record per line
+	static bool print_file(const std::string& filepath, FILE* out);
+
+private:
+	std::vector<trace_record> records;
+	uint64_t mask;
+	std::atomic<uint64_t> written{ 0 };
+
+	std::thread writer;
+	std::atomic<bool> stop_writer{ false };
+	std::atomic<uint64_t> lost{ 0 };
+	std::mutex wake_lock;
+	std::condition_variable wake;
+
+	void write_loop(FILE* file, uint64_t from);
+};
+
+// Which register an instruction writes, for trace_record::reg
+inline uint8_t written_register(const instruction& ins)
+{
+	switch (ins.id)
+	{
+	case opcode_id::OP_6xkk: case opcode_id::OP_7xkk: case opcode_id::OP_8xy0:
+	case opcode_id::OP_8xy1: case opcode_id::OP_8xy2: case opcode_id::OP_8xy3:
+	case opcode_id::OP_8xy4: case opcode_id::OP_8xy5: case opcode_id::OP_8xy6:
+	case opcode_id::OP_8xy7: case opcode_id::OP_8xyE: case opcode_id::OP_Cxkk:
+	case opcode_id::OP_Fx07: case opcode_id::OP_Fx0A: case opcode_id::OP_Fx65:
+		return ins.x;
+	case opcode_id::OP_Dxyn:
+		return 0xF;
+	default:
+		return TRACE_NO_REGISTER;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/*
+	Hands the latest value from one writer thread to one reader thread
+	without locks. The writer fills back() and publishes it, the reader
+	picks up whatever was published last; values published in between
+	are skipped. Neither side ever waits for the other.
+*/
+template <typename T>
+struct triple_buffer
+{
+public:
+	// writer side
+	T& back() { return slots[back_index]; }
+	void publish()
+	{
+		back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// reader side, true when front() changed since the last call
+	bool update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	const T& front() const { return slots[front_index]; }
+
+private:
+	static constexpr uint32_t INDEX = 0x3;
+	static constexpr uint32_t FRESH = 0x4;
+
+	T slots[3]{};
+	uint32_t back_index = 0;
+	uint32_t front_index = 1;
+
+	// the slot between the two sides, with FRESH set while the
+	// reader hasn't taken it yet
+	std::atomic<uint32_t> middle{ 2 };
+};
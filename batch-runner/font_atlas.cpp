@@ -0,0 +1,125 @@
+#include "font_atlas.h"
+#include "framework.h"
+
+#include <cstdio>
+#include <vector>
+
+#define SPRITE_GLYPH_WIDTH 6
+#define SPRITE_GLYPH_HEIGHT 7
+// texels that aren't part of a glyph
+#define SPRITE_BACKGROUND 0xFFFFFFFFu
+
+/*
+	Every sheet has one glyph per 6 texels, the first column of each is
+	left empty. The order of the characters can't be told from the
+	textures, neither can how wide every glyph is.
+*/
+static const struct
+{
+	const char* file;
+	const char* characters;
+	uint8_t widths[26];
+} sheets[] = {
+	{ "characters.spr", "abcdefghijklmnopqrstuvwxyz",
+		{ 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 5, 4, 5, 5, 3, 4, 4 } },
+	{ "numbers.spr", "0123456789",
+		{ 4, 2, 4, 4, 4, 4, 4, 4, 4, 4 } },
+	{ "symbols.spr", "!?:;.,[]=*/-+<>\\",
+		{ 1, 4, 1, 2, 1, 2, 2, 2, 4, 1, 5, 4, 5, 5, 5, 2 } }
+};
+
+static bool read_sprite(const std::string& filepath, uint32_t& width, uint32_t& height, std::vector<uint32_t>& texels)
+{
+	FILE* file = fopen(filepath.c_str(), "rb");
+	if (!file)
+		return false;
+
+	bool read = fread(&width, 4, 1, file) == 1 && fread(&height, 4, 1, file) == 1;
+	if (read)
+	{
+		texels.resize((size_t)width * height);
+		read = fread(texels.data(), 4, texels.size(), file) == texels.size();
+	}
+	fclose(file);
+	return read;
+}
+
+bool convert_font(const std::string& folder)
+{
+	struct entry
+	{
+		uint8_t character;
+		uint8_t width;
+		uint16_t offset;
+	};
+	std::vector<entry> entries;
+	std::vector<uint8_t> rows;
+
+	for (const auto& sheet : sheets)
+	{
+		uint32_t width, height;
+		std::vector<uint32_t> texels;
+		if (!read_sprite(folder + sheet.file, width, height, texels))
+		{
+			printf("can't read %s%s\n", folder.c_str(), sheet.file);
+			return false;
+		}
+
+		for (uint32_t n = 0; sheet.characters[n]; n++)
+		{
+			uint8_t glyph_width = sheet.widths[n];
+			if (height < SPRITE_GLYPH_HEIGHT || (n + 1) * SPRITE_GLYPH_WIDTH > width)
+			{
+				printf("%s%s is too small for '%c'\n", folder.c_str(), sheet.file, sheet.characters[n]);
+				return false;
+			}
+
+			entry glyph = { (uint8_t)sheet.characters[n], glyph_width, (uint16_t)rows.size() };
+			entries.push_back(glyph);
+			// upper case letters share the lower case glyphs
+			if (glyph.character >= 'a' && glyph.character <= 'z')
+				entries.push_back({ (uint8_t)(glyph.character - 'a' + 'A'), glyph.width, glyph.offset });
+
+			for (uint32_t i = 0; i < SPRITE_GLYPH_HEIGHT; i++)
+			{
+				uint8_t bits = 0;
+				for (uint32_t j = 0; j < glyph_width; j++)
+					if (texels[i * width + n * SPRITE_GLYPH_WIDTH + 1 + j] != SPRITE_BACKGROUND)
+						bits |= 1u << j;
+				rows.push_back(bits);
+			}
+		}
+	}
+
+	std::string filepath = folder + FM_FONT_FILE;
+	FILE* file = fopen(filepath.c_str(), "wb");
+	if (!file)
+	{
+		printf("can't write %s\n", filepath.c_str());
+		return false;
+	}
+
+	uint32_t magic = FM_FONT_MAGIC;
+	uint16_t version = FM_FONT_VERSION;
+	uint8_t glyph_height = SPRITE_GLYPH_HEIGHT, reserved = 0;
+	uint16_t glyph_count = (uint16_t)entries.size(), row_count = (uint16_t)rows.size();
+	fwrite(&magic, 4, 1, file);
+	fwrite(&version, 2, 1, file);
+	fwrite(&glyph_height, 1, 1, file);
+	fwrite(&reserved, 1, 1, file);
+	fwrite(&glyph_count, 2, 1, file);
+	fwrite(&row_count, 2, 1, file);
+	for (const entry& glyph : entries)
+	{
+		fwrite(&glyph.character, 1, 1, file);
+		fwrite(&glyph.width, 1, 1, file);
+		fwrite(&glyph.offset, 2, 1, file);
+	}
+	fwrite(rows.data(), 1, rows.size(), file);
+
+	bool written = !ferror(file);
+	fclose(file);
+	if (written)
+		printf("%u glyphs, %u rows in %s\n", glyph_count, row_count, filepath.c_str());
+	return written;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+
+// Turns characters.spr, numbers.spr and symbols.spr of a font folder into
+// the atlas fm::application::load_font reads (FM_FONT_FILE, see
+// framework.h), next to them
+bool convert_font(const std::string& folder);
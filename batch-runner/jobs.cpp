@@ -0,0 +1,233 @@
+#include "jobs.h"
+#include "chip8.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+// Splits a line on whitespace, "double quoted" parts stay together
+static std::vector<std::string> split_fields(const std::string& line)
+{
+	std::vector<std::string> fields;
+	size_t i = 0;
+	while (i < line.size())
+	{
+		while (i < line.size() && isspace((unsigned char)line[i]))
+			i++;
+		if (i == line.size())
+			break;
+
+		std::string field;
+		if (line[i] == '"')
+		{
+			size_t end = line.find('"', i + 1);
+			if (end == std::string::npos)
+				end = line.size();
+			field = line.substr(i + 1, end - i - 1);
+			i = end + 1;
+		}
+		else
+		{
+			size_t end = i;
+			while (end < line.size() && !isspace((unsigned char)line[end]))
+				end++;
+			field = line.substr(i, end - i);
+			i = end;
+		}
+		fields.push_back(field);
+	}
+	return fields;
+}
+
+static bool load_input(const std::string& filepath, std::vector<key_event>& keys)
+{
+	std::ifstream file(filepath);
+	if (!file)
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		uint64_t cycle;
+		unsigned int key;
+		char state[8];
+		if (sscanf(line.c_str(), "%llu %x %7s", (unsigned long long*)&cycle, &key, state) == 3 && key < 16)
+			keys.push_back({ cycle, (uint8_t)key, strcmp(state, "down") == 0 });
+	}
+
+	std::stable_sort(keys.begin(), keys.end(),
+		[](const key_event& a, const key_event& b) { return a.cycle < b.cycle; });
+	return true;
+}
+
+bool batch::load_manifest(const std::string& filepath)
+{
+	std::ifstream file(filepath);
+	if (!file)
+	{
+		std::cout << "can't open manifest " << filepath << "\n";
+		return false;
+	}
+
+	std::filesystem::path folder = std::filesystem::path(filepath).parent_path();
+	auto resolve = [&](const std::string& path) {
+		std::filesystem::path p(path);
+		return (p.is_relative() ? folder / p : p).string();
+	};
+
+	std::string line;
+	uint32_t number = 0;
+	while (std::getline(file, line))
+	{
+		number++;
+		std::vector<std::string> fields = split_fields(line);
+		if (fields.empty() || fields[0][0] == '#')
+			continue;
+
+		if (fields.size() != 4)
+		{
+			std::cout << filepath << ":" << number << ": expected <rom> <input> <cycles> <seed>\n";
+			return false;
+		}
+
+		job work;
+		char* cycles_end;
+		char* seed_end;
+		work.rom = resolve(fields[0]);
+		work.input = fields[1] == "-" ? "" : resolve(fields[1]);
+		work.cycles = strtoull(fields[2].c_str(), &cycles_end, 0);
+		work.seed = strtoull(fields[3].c_str(), &seed_end, 0);
+		if (*cycles_end || *seed_end)
+		{
+			std::cout << filepath << ":" << number << ": cycles and seed must be numbers\n";
+			return false;
+		}
+		jobs.push_back(work);
+
+		if (!work.input.empty() && !inputs.count(work.input))
+		{
+			if (!load_input(work.input, inputs[work.input]))
+			{
+				std::cout << "can't open input script " << work.input << "\n";
+				return false;
+			}
+		}
+	}
+
+	// the map doesn't move its nodes, so the pointers stay good
+	for (job& work : jobs)
+		if (!work.input.empty())
+			work.keys = &inputs[work.input];
+	return true;
+}
+
+job_result run_job(const job& work, uint32_t instructions_per_second)
+{
+	job_result result;
+	auto start = std::chrono::steady_clock::now();
+
+	// the decoded instruction cache makes chip8 too big for a thread's stack
+	std::unique_ptr<chip8> interpreter = std::make_unique<chip8>();
+	interpreter->initialize();
+
+	FILE* file = fopen(work.rom.c_str(), "rb");
+	result.loaded = file != NULL;
+	if (file)
+		fclose(file);
+	if (!result.loaded)
+		return result;
+	interpreter->load_rom(work.rom);
+	interpreter->seed(work.seed);
+
+	scheduler timing;
+	timing.instructions_per_second = instructions_per_second;
+
+	// runs up to the next key change, applies it and goes on
+	static const std::vector<key_event> no_keys;
+	const std::vector<key_event>& keys = work.keys ? *work.keys : no_keys;
+	size_t next_key = 0;
+	uint64_t executed = 0;
+	while (executed < work.cycles)
+	{
+		for (; next_key < keys.size() && keys[next_key].cycle <= executed; next_key++)
+			interpreter->keypad[keys[next_key].key] = keys[next_key].down;
+
+		uint64_t count = work.cycles - executed;
+		if (next_key < keys.size() && keys[next_key].cycle - executed < count)
+			count = keys[next_key].cycle - executed;
+
+		timing.run_instructions(*interpreter, count);
+		executed += count;
+	}
+
+	result.frame_hash = interpreter->display_hash();
+	memcpy(result.registers, interpreter->registers, sizeof(result.registers));
+	result.pc = interpreter->pc;
+	result.index = interpreter->index;
+	result.cycles = executed;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static std::string json_escape(const std::string& text)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+// .json gets an array of objects, anything else is CSV
+bool write_results(const std::string& filepath, const batch& jobs, const std::vector<job_result>& results)
+{
+	FILE* file = fopen(filepath.c_str(), "w");
+	if (file == NULL)
+	{
+		std::cout << "can't write " << filepath << "\n";
+		return false;
+	}
+
+	bool json = std::filesystem::path(filepath).extension() == ".json";
+	if (json)
+		fprintf(file, "[\n");
+	else
+		fprintf(file, "rom,input,seed,loaded,frame_hash,pc,index,registers,cycles,seconds\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const job& work = jobs.jobs[i];
+		const job_result& result = results[i];
+
+		char registers[33];
+		for (uint32_t r = 0; r < 16; r++)
+			snprintf(registers + r * 2, 3, "%02X", result.registers[r]);
+
+		if (json)
+			fprintf(file, "  { \"rom\": \"%s\", \"input\": \"%s\", \"seed\": %llu, \"loaded\": %s, \"frame_hash\": \"%016llx\", "
+				"\"pc\": %u, \"index\": %u, \"registers\": \"%s\", \"cycles\": %llu, \"seconds\": %.6f }%s\n",
+				json_escape(work.rom).c_str(), json_escape(work.input).c_str(), (unsigned long long)work.seed,
+				result.loaded ? "true" : "false", (unsigned long long)result.frame_hash, result.pc, result.index,
+				registers, (unsigned long long)result.cycles, result.seconds, i + 1 < results.size() ? "," : "");
+		else
+			fprintf(file, "\"%s\",\"%s\",%llu,%d,%016llx,%u,%u,%s,%llu,%.6f\n",
+				work.rom.c_str(), work.input.c_str(), (unsigned long long)work.seed, result.loaded,
+				(unsigned long long)result.frame_hash, result.pc, result.index, registers,
+				(unsigned long long)result.cycles, result.seconds);
+	}
+
+	if (json)
+		fprintf(file, "]\n");
+	fclose(file);
+	return true;
+}
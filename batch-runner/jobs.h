@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Keypad change `cycle` instructions into a run
+struct key_event
+{
+	uint64_t cycle;
+	uint8_t key;
+	bool down;
+};
+
+struct job
+{
+	std::string rom;
+	std::string input;
+	uint64_t cycles;
+	uint64_t seed;
+
+	// points into the batch's input scripts, null without one
+	const std::vector<key_event>* keys = nullptr;
+};
+
+struct job_result
+{
+	uint64_t frame_hash = 0;
+	uint8_t registers[16]{};
+	uint16_t pc = 0;
+	uint16_t index = 0;
+	uint64_t cycles = 0;
+	double seconds = 0.0;
+	bool loaded = false;
+};
+
+/*
+	A manifest has one job per line:
+		<rom> <input script or -> <cycles> <seed>
+	Paths with spaces go in double quotes, relative ones are relative to the
+	manifest. Empty lines and lines starting with # are skipped.
+	An input script has one "<cycle> <key 0-F> <down|up>" per line.
+*/
+struct batch
+{
+	std::vector<job> jobs;
+
+	// every script is read once no matter how many jobs use it
+	std::map<std::string, std::vector<key_event>> inputs;
+
+	bool load_manifest(const std::string& filepath);
+};
+
+// Runs one job on its own chip8 seeded with the job's seed at
+// `instructions_per_second`, which only decides how often the timers tick
+job_result run_job(const job& work, uint32_t instructions_per_second);
+
+bool write_results(const std::string& filepath, const batch& jobs, const std::vector<job_result>& results);
@@ -0,0 +1,186 @@
+#include "analysis.h"
+#include "font_atlas.h"
+#include "input_log.h"
+#include "jobs.h"
+#include "rom_library.h"
+#include "trace.h"
+#include "work_pool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void usage()
+{
+	printf("usage: batch-runner <manifest> [-o results.csv|results.json] [-j threads] [--ips n]\n");
+	printf("       batch-runner --replay <input log>... [-j threads]\n");
+	printf("       batch-runner --trace <trace>\n");
+	printf("       batch-runner --pack <rom folder> <archive" ROM_ARCHIVE_EXTENSION ">\n");
+	printf("       batch-runner --analyze <rom folder|archive" ROM_ARCHIVE_EXTENSION ">\n");
+	printf("       batch-runner --font <font folder>\n");
+}
+
+// What rom_analysis finds in every rom, the same thing the emulator
+// keeps in its rom database
+static int analyze(const std::string& path)
+{
+	rom_library library;
+	if (!library.open(path))
+	{
+		printf("can't open %s\n", path.c_str());
+		return 1;
+	}
+
+	printf("%-24s %-16s %6s %12s %7s %6s\n", "rom", "hash", "bytes", "instructions", "blocks", "fused");
+	for (size_t i = 0; i < library.size(); i++)
+	{
+		const rom_entry& rom = library[i];
+		rom_analysis analysis;
+		analyze_rom(library.data(rom), rom.size, analysis);
+
+		uint32_t fused = 0;
+		for (uint32_t address = MEMORY_START_ADRESS; address < 4096; address++)
+			fused += analysis.fusion(address) != fusion_id::NONE;
+		printf("%-24s %016llx %6u %12u %7u %6u\n", rom.name.c_str(), (unsigned long long)rom.hash,
+			rom.size, analysis.instructions, analysis.block_count, fused);
+	}
+	return 0;
+}
+
+// Plays back input logs recorded with F5 in the emulator, fails unless
+// every one of them ends on the display it was recorded with
+static int replay(const std::vector<std::string>& logs, uint32_t threads)
+{
+	work_pool pool(threads);
+	std::vector<replay_result> results(logs.size());
+
+	pool.run((uint32_t)logs.size(), [&](uint32_t index, uint32_t worker) {
+		results[index] = replay_input_log(logs[index]);
+	});
+
+	uint32_t failed = 0;
+	for (size_t i = 0; i < logs.size(); i++)
+	{
+		const replay_result& result = results[i];
+		const char* verdict = !result.loaded ? "UNREADABLE" : result.matched ? "OK" : "MISMATCH";
+		printf("%-10s %s: %llu instructions, %llu events, %.0f instructions/s, hash %016llx\n", verdict, logs[i].c_str(),
+			(unsigned long long)result.cycles, (unsigned long long)result.events,
+			result.seconds > 0.0 ? result.cycles / result.seconds : 0.0, (unsigned long long)result.hash);
+		failed += !result.matched;
+	}
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string manifest;
+	std::string output = "results.csv";
+	uint32_t threads = std::thread::hardware_concurrency();
+	uint32_t ips = 700;
+	bool replaying = false;
+	std::vector<std::string> logs;
+
+	// prints a trace streamed with F6 in the emulator
+	if (argc == 3 && strcmp(argv[1], "--trace") == 0)
+	{
+		if (trace_ring::print_file(argv[2], stdout))
+			return 0;
+		printf("%s isn't a trace\n", argv[2]);
+		return 1;
+	}
+
+	// packs a folder into one archive the emulator can map, see rom_library.h
+	if (argc == 4 && strcmp(argv[1], "--pack") == 0)
+	{
+		rom_library library;
+		if (!library.open(argv[2]) || !library.write_archive(argv[3]))
+		{
+			printf("can't pack %s into %s\n", argv[2], argv[3]);
+			return 1;
+		}
+		printf("packed %zu roms into %s, %zu left out\n", library.size(), argv[3], library.rejected());
+		return 0;
+	}
+
+	if (argc == 3 && strcmp(argv[1], "--analyze") == 0)
+		return analyze(argv[2]);
+
+	// turns the .spr textures of a font folder into the atlas the emulator loads
+	if (argc == 3 && strcmp(argv[1], "--font") == 0)
+		return convert_font(argv[2]) ? 0 : 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--replay") == 0)
+			replaying = true;
+		else if (replaying && argv[i][0] != '-')
+			logs.push_back(argv[i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+			ips = (uint32_t)atoi(argv[++i]);
+		else if (argv[i][0] != '-' && manifest.empty())
+			manifest = argv[i];
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	if (replaying)
+	{
+		if (logs.empty())
+		{
+			usage();
+			return 1;
+		}
+		return replay(logs, threads);
+	}
+
+	// unlimited has no meaning without a clock, the timers need a rate
+	if (manifest.empty() || ips == 0)
+	{
+		usage();
+		return 1;
+	}
+
+	batch jobs;
+	if (!jobs.load_manifest(manifest))
+		return 1;
+
+	work_pool pool(threads);
+	std::vector<job_result> results(jobs.jobs.size());
+	std::vector<uint64_t> per_thread(pool.thread_count());
+
+	auto start = std::chrono::steady_clock::now();
+	pool.run((uint32_t)jobs.jobs.size(), [&](uint32_t index, uint32_t worker) {
+		results[index] = run_job(jobs.jobs[index], ips);
+		per_thread[worker] += results[index].cycles;
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t instructions = 0;
+	uint32_t failed = 0;
+	for (const job_result& result : results)
+	{
+		instructions += result.cycles;
+		failed += !result.loaded;
+	}
+
+	printf("%zu jobs on %u threads in %.3f s, %llu stolen\n", results.size(), pool.thread_count(), seconds,
+		(unsigned long long)pool.stolen_jobs());
+	printf("%.0f instructions/s\n", instructions / seconds);
+	for (uint32_t i = 0; i < pool.thread_count(); i++)
+		printf("  thread %-3u %14llu instructions\n", i, (unsigned long long)per_thread[i]);
+	if (failed)
+		printf("%u roms couldn't be opened\n", failed);
+
+	return write_results(output, jobs, results) ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include "work_pool.h"
+
+#include <thread>
+
+#define RANGE(begin, end) (((uint64_t)(begin) << 32u) | (uint32_t)(end))
+#define RANGE_BEGIN(range) (uint32_t)((range) >> 32u)
+#define RANGE_END(range) (uint32_t)(range)
+
+work_pool::work_pool(uint32_t threads)
+	: threads(threads ? threads : 1), slices(new slice[threads ? threads : 1])
+{
+}
+
+void work_pool::run(uint32_t count, const std::function<void(uint32_t, uint32_t)>& job)
+{
+	stolen.store(0);
+	for (uint32_t i = 0; i < threads; i++)
+	{
+		uint32_t begin = (uint32_t)((uint64_t)count * i / threads);
+		uint32_t end = (uint32_t)((uint64_t)count * (i + 1) / threads);
+		slices[i].range.store(RANGE(begin, end));
+	}
+
+	// the calling thread is worker 0
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < threads; i++)
+		workers.emplace_back(&work_pool::work, this, i, std::cref(job));
+	work(0, job);
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void work_pool::work(uint32_t worker, const std::function<void(uint32_t, uint32_t)>& job)
+{
+	uint32_t index;
+	do
+	{
+		while (take(worker, index))
+			job(index, worker);
+	} while (steal(worker));
+}
+
+bool work_pool::take(uint32_t worker, uint32_t& index)
+{
+	std::atomic<uint64_t>& range = slices[worker].range;
+	uint64_t current = range.load(std::memory_order_relaxed);
+	while (RANGE_BEGIN(current) < RANGE_END(current))
+	{
+		if (range.compare_exchange_weak(current, RANGE(RANGE_BEGIN(current) + 1, RANGE_END(current)), std::memory_order_relaxed))
+		{
+			index = RANGE_BEGIN(current);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Only called with our own slice empty. Nothing new is ever added, so once
+// every slice is empty the worker is done
+bool work_pool::steal(uint32_t worker)
+{
+	for (;;)
+	{
+		uint32_t victim = worker;
+		uint32_t most = 0;
+		for (uint32_t i = 0; i < threads; i++)
+		{
+			uint64_t range = slices[i].range.load(std::memory_order_relaxed);
+			uint32_t left = RANGE_END(range) - RANGE_BEGIN(range);
+			if (i != worker && RANGE_BEGIN(range) < RANGE_END(range) && left > most)
+			{
+				victim = i;
+				most = left;
+			}
+		}
+
+		if (victim == worker)
+			return false;
+
+		std::atomic<uint64_t>& range = slices[victim].range;
+		uint64_t current = range.load(std::memory_order_relaxed);
+		uint32_t begin = RANGE_BEGIN(current), end = RANGE_END(current);
+		if (begin >= end)
+			continue;
+
+		// the owner keeps working from the front, the last job stays with it
+		// unless it's the only one left
+		uint32_t half = (end - begin + 1) / 2;
+		if (!range.compare_exchange_strong(current, RANGE(begin, end - half), std::memory_order_relaxed))
+			continue;
+
+		// thieves only compare-exchange a slice that isn't empty and indices
+		// never come back, so a plain store can't lose a concurrent steal
+		slices[worker].range.store(RANGE(end - half, end), std::memory_order_relaxed);
+		stolen.fetch_add(half, std::memory_order_relaxed);
+		return true;
+	}
+}
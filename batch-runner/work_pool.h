@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+	Runs a fixed set of independent jobs 0 .. count - 1 on `threads` threads.
+	Every worker starts with an equal slice of the indices and takes them
+	from the front. A worker that runs dry steals the back half of the
+	fullest slice it can find, so long jobs don't leave cores idle. A slice
+	is one 64 bit word (begin << 32 | end), taking and stealing are a single
+	compare-exchange each, and no job ever waits on a lock.
+*/
+struct work_pool
+{
+public:
+	work_pool(uint32_t threads);
+
+	// Calls job(index, worker) once for every index, returns when all are done
+	void run(uint32_t count, const std::function<void(uint32_t, uint32_t)>& job);
+
+	uint32_t thread_count() { return threads; }
+
+	// Jobs that ran on another worker than the one they started on, last run()
+	uint64_t stolen_jobs() { return stolen; }
+
+private:
+	// own cache line each, workers hammer their own slice
+	struct alignas(64) slice
+	{
+		std::atomic<uint64_t> range{ 0 };
+	};
+
+	uint32_t threads;
+	std::unique_ptr<slice[]> slices;
+	std::atomic<uint64_t> stolen{ 0 };
+
+	bool take(uint32_t worker, uint32_t& index);
+	bool steal(uint32_t worker);
+	void work(uint32_t worker, const std::function<void(uint32_t, uint32_t)>& job);
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+struct bench_harness;
+
+void bench_roms(const std::string& path, uint64_t cycles);
+void bench_fusion(const std::string& path, uint64_t cycles);
+void bench_draw(uint64_t sprites);
+void bench_blit();
+void bench_threading(const std::string& rom, double seconds);
+void bench_lanes(const std::string& path, uint64_t cycles);
+void bench_savestate(const std::string& path, uint64_t snapshots);
+void bench_micro(bench_harness& harness, const std::string& roms);
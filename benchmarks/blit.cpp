@@ -0,0 +1,89 @@
+#include "benchmarks.h"
+#include "blit.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// What application::draw_framebuffer did before fm::blit_scaled: one
+// clamped quad fill per source pixel
+static void quad_fill(uint32_t* dst, uint32_t dst_w, uint32_t dst_h, uint32_t c, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+	uint32_t start_x = x < dst_w ? x : dst_w;
+	uint32_t end_x = x + w < dst_w ? x + w : dst_w;
+	uint32_t start_y = y < dst_h ? y : dst_h;
+	uint32_t end_y = y + h < dst_h ? y + h : dst_h;
+
+	for (uint32_t py = start_y; py < end_y; py++)
+		for (uint32_t px = start_x; px < end_x; px++)
+			dst[py * dst_w + px] = c;
+}
+
+static void quad_fill_blit(uint32_t* dst, uint32_t dst_w, uint32_t dst_h,
+	const uint32_t* src, uint32_t src_w, uint32_t src_h, uint32_t x, uint32_t y, uint32_t s)
+{
+	uint32_t pos_y = y + src_h * s;
+	for (uint32_t i = 0; i < src_h; i++)
+	{
+		uint32_t pos_x = x;
+		for (uint32_t j = 0; j < src_w; j++)
+		{
+			quad_fill(dst, dst_w, dst_h, src[i * src_w + j], pos_x, pos_y, s, s);
+			pos_x += s;
+		}
+		pos_y -= s;
+	}
+}
+
+template <typename F>
+static double frames_per_second(F draw)
+{
+	// enough frames for roughly the same amount of work at every scale
+	uint32_t frames = 0;
+	auto start = std::chrono::steady_clock::now();
+	double seconds = 0.0;
+	do
+	{
+		for (uint32_t i = 0; i < 64; i++)
+			draw();
+		frames += 64;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (seconds < 0.05);
+
+	return frames / seconds;
+}
+
+// Draws a 64x32 chip-8 frame at every integer scale into the window
+// buffer sizes the emulator uses, old per-pixel path against blit_scaled
+void bench_blit()
+{
+	const uint32_t sizes[][2] = { { 320, 200 }, { 1280, 720 }, { 1920, 1080 } };
+	const uint32_t src_w = 64, src_h = 32;
+
+	std::vector<uint32_t> src(src_w * src_h);
+	for (auto& pixel : src)
+		pixel = rand() % 2 ? 0xFFFFFFFF : 0x00000000;
+
+	printf("\n%-24s %16s %16s %8s  (sse2 %d, avx2 %d)\n", "blit", "quad fill fps", "blit_scaled fps", "speedup", FM_SSE2, FM_AVX2);
+	for (const auto& size : sizes)
+	{
+		uint32_t w = size[0], h = size[1];
+		std::vector<uint32_t> reference(w * h), fast(w * h);
+
+		for (uint32_t s = 1; s <= 16; s++)
+		{
+			quad_fill_blit(reference.data(), w, h, src.data(), src_w, src_h, 0, 35, s);
+			fm::blit_scaled(fast.data(), w, h, src.data(), src_w, src_h, 0, 35, s, 0, src_h);
+			if (reference != fast)
+				printf("blit_scaled doesn't match at %ux%u scale %u\n", w, h, s);
+
+			double slow_fps = frames_per_second([&] { quad_fill_blit(reference.data(), w, h, src.data(), src_w, src_h, 0, 35, s); });
+			double fast_fps = frames_per_second([&] { fm::blit_scaled(fast.data(), w, h, src.data(), src_w, src_h, 0, 35, s, 0, src_h); });
+
+			char label[32];
+			snprintf(label, sizeof(label), "%ux%u x%u", w, h, s);
+			printf("%-24s %16.0f %16.0f %7.1fx\n", label, slow_fps, fast_fps, fast_fps / slow_fps);
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#include "benchmarks.h"
+#include "chip8.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// A program that does nothing but draw: picks a random position and
+// draws a 15 row sprite there, over and over
+//   200: C03F  RND V0, 3F
+//   202: C11F  RND V1, 1F
+//   204: A300  LD I, 300
+//   206: D01F  DRW V0, V1, F
+//   208: 1200  JP 200
+static const uint8_t draw_program[] = {
+	0xC0, 0x3F, 0xC1, 0x1F, 0xA3, 0x00, 0xD0, 0x1F, 0x12, 0x00
+};
+
+void bench_draw(uint64_t sprites)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	memcpy(&interpreter.memory[MEMORY_START_ADRESS], draw_program, sizeof(draw_program));
+	for (uint32_t i = 0; i < 15; i++)
+		interpreter.memory[0x300 + i] = 0xA5 ^ (i * 0x11);
+	interpreter.invalidate(MEMORY_START_ADRESS, PROGRAM_SIZE);
+
+	uint64_t cycles = sprites * 5;
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < cycles; i++)
+		interpreter.cycle();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("\n%-24s %16s\n", "draw", "sprites/s");
+	printf("%-24s %16.0f\n", "15 row sprites", sprites / seconds);
+}
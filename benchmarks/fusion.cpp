@@ -0,0 +1,77 @@
+#include "benchmarks.h"
+#include "chip8.h"
+
+#include <cstdio>
+#include <filesystem>
+
+static uint16_t opcode_at(chip8& interpreter, uint16_t address)
+{
+	return (interpreter.memory[address] << 8u) | interpreter.memory[address + 1];
+}
+
+// How often each candidate sequence shows up in the dynamic instruction
+// stream, this is what decided which ones chip8::decode_slot fuses
+static void count_sequences(const std::string& rom, uint64_t cycles)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	interpreter.load_rom(rom);
+
+	uint64_t annn_dxyn = 0, ld_timer = 0, skip_jp = 0, delay_wait = 0, spin = 0;
+	opcode_id previous = opcode_id::INVALID;
+	uint16_t previous_pc = 0;
+	uint16_t before_previous_pc = 0;
+
+	for (uint64_t i = 0; i < cycles; i++)
+	{
+		uint16_t opcode = opcode_at(interpreter, interpreter.pc);
+		opcode_id id = decode(opcode);
+
+		if (previous == opcode_id::OP_Annn && id == opcode_id::OP_Dxyn)
+			annn_dxyn++;
+		if (previous == opcode_id::OP_6xkk && (id == opcode_id::OP_Fx15 || id == opcode_id::OP_Fx18))
+			ld_timer++;
+		if ((previous == opcode_id::OP_3xkk || previous == opcode_id::OP_4xkk) && id == opcode_id::OP_1nnn)
+			skip_jp++;
+		// the three ran one after the other and find_fusion agrees on the
+		// operands (same x, a 3x00, the jump going back to the Fx07)
+		if (id == opcode_id::OP_1nnn && previous_pc + 2 == interpreter.pc && before_previous_pc + 4 == interpreter.pc &&
+			find_fusion(interpreter.memory, before_previous_pc) == fusion_id::DELAY_WAIT)
+			delay_wait++;
+		if (id == opcode_id::OP_1nnn && (opcode & 0x0FFFu) == interpreter.pc)
+			spin++;
+
+		before_previous_pc = previous_pc;
+		previous = id;
+		previous_pc = interpreter.pc;
+		interpreter.cycle();
+	}
+
+	auto percent = [&](uint64_t n) { return 100.0 * n / cycles; };
+	printf("%-24s %9.2f%% %9.2f%% %9.2f%% %9.2f%% %9.2f%%\n",
+		std::filesystem::path(rom).filename().string().c_str(),
+		percent(annn_dxyn), percent(ld_timer), percent(skip_jp), percent(delay_wait), percent(spin));
+}
+
+static double fused_share(const std::string& rom, uint64_t cycles)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	interpreter.load_rom(rom);
+	interpreter.run(cycles);
+
+	return 100.0 * interpreter.fused_instructions / cycles;
+}
+
+void bench_fusion(const std::string& path, uint64_t cycles)
+{
+	printf("\nsequences, share of executed instructions\n");
+	printf("%-24s %10s %10s %10s %10s %10s\n", "rom", "Annn+Dxyn", "6xkk+Fx1x", "skip+1nnn", "delay wait", "spin");
+	for (const auto& game : std::filesystem::directory_iterator(path))
+		count_sequences(game.path().string(), cycles);
+
+	printf("\nfused by run()\n");
+	printf("%-24s %10s\n", "rom", "fused");
+	for (const auto& game : std::filesystem::directory_iterator(path))
+		printf("%-24s %9.2f%%\n", game.path().filename().string().c_str(), fused_share(game.path().string(), cycles));
+}
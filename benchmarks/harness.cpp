@@ -0,0 +1,108 @@
+#include "harness.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+
+static std::string json_escape(const std::string& text)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+static const char* build_name()
+{
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+#define BENCH_STRINGIFY(x) #x
+#define BENCH_VERSION(x) BENCH_STRINGIFY(x)
+	return "msvc " BENCH_VERSION(_MSC_FULL_VER);
+#else
+	return "unknown";
+#endif
+}
+
+void bench_harness::print_header() const
+{
+	printf("\n%-40s %12s %12s %12s %12s\n", "microbenchmark", "median ns", "min ns", "max ns", "iterations");
+}
+
+void bench_harness::print(const bench_result& result) const
+{
+	printf("%-40s %12.2f %12.2f %12.2f %12llu\n", result.name.c_str(),
+		result.median_ns, result.min_ns, result.max_ns, (unsigned long long)result.iterations);
+}
+
+bool bench_harness::write_json(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		printf("can't write %s\n", path.c_str());
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"build\": \"%s\",\n", json_escape(build_name()).c_str());
+	fprintf(file, "\t\"repetitions\": %u,\n\t\"results\": [\n", repetitions);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const bench_result& r = results[i];
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f, \"iterations\": %llu }%s\n",
+			json_escape(r.name).c_str(), r.median_ns, r.min_ns, r.max_ns, (unsigned long long)r.iterations,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+void bench_harness::compare(const std::string& path) const
+{
+	std::ifstream file(path);
+	if (!file.good())
+	{
+		printf("can't open %s\n", path.c_str());
+		return;
+	}
+
+	// only reads back what write_json writes, one result per line
+	std::unordered_map<std::string, double> previous;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t name = line.find("\"name\": \"");
+		size_t median = line.find("\"median_ns\": ");
+		if (name == std::string::npos || median == std::string::npos)
+			continue;
+
+		std::string key;
+		for (size_t i = name + 9; i < line.size() && line[i] != '"'; i++)
+		{
+			if (line[i] == '\\')
+				i++;
+			key += line[i];
+		}
+		previous[key] = atof(line.c_str() + median + 13);
+	}
+
+	printf("\n%-40s %12s %12s %8s\n", "compared to", "before ns", "now ns", "change");
+	for (const auto& r : results)
+	{
+		auto it = previous.find(r.name);
+		if (it == previous.end())
+			printf("%-40s %12s %12.2f %8s\n", r.name.c_str(), "-", r.median_ns, "new");
+		else
+			printf("%-40s %12.2f %12.2f %+7.1f%%\n", r.name.c_str(), it->second, r.median_ns,
+				(r.median_ns / it->second - 1.0) * 100.0);
+	}
+}
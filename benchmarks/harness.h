@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+	Small microbenchmark harness. Every case first runs for warmup_seconds
+	while the batch size doubles until one batch takes at least
+	batch_seconds, then the same batch is timed `repetitions` times. The
+	median is what gets reported and compared, min/max show the noise.
+*/
+struct bench_result
+{
+	std::string name;
+	double median_ns = 0.0;
+	double min_ns = 0.0;
+	double max_ns = 0.0;
+	uint64_t iterations = 0;
+	uint32_t repetitions = 0;
+};
+
+struct bench_harness
+{
+	uint32_t repetitions = 7;
+	double warmup_seconds = 0.05;
+	double batch_seconds = 0.02;
+
+	// only cases whose name contains this run, everything when empty
+	std::string filter;
+
+	std::vector<bench_result> results;
+
+	bool enabled(const std::string& name) const { return filter.empty() || name.find(filter) != std::string::npos; }
+
+	// `op` is called once per iteration, everything it needs is set up
+	// beforehand so only the call itself gets timed
+	template <typename F>
+	void measure(const std::string& name, F op)
+	{
+		if (!enabled(name))
+			return;
+
+		typedef std::chrono::steady_clock clock;
+		auto time_batch = [&](uint64_t iterations)
+		{
+			auto start = clock::now();
+			for (uint64_t i = 0; i < iterations; i++)
+				op();
+			return std::chrono::duration<double>(clock::now() - start).count();
+		};
+
+		uint64_t iterations = 1;
+		double warmed = 0.0;
+		while (true)
+		{
+			double seconds = time_batch(iterations);
+			warmed += seconds;
+			if (seconds >= batch_seconds && warmed >= warmup_seconds)
+				break;
+			if (seconds < batch_seconds)
+				iterations *= 2;
+		}
+
+		std::vector<double> samples(repetitions);
+		for (auto& sample : samples)
+			sample = time_batch(iterations) * 1e9 / iterations;
+		std::sort(samples.begin(), samples.end());
+
+		bench_result result;
+		result.name = name;
+		result.median_ns = samples[samples.size() / 2];
+		result.min_ns = samples.front();
+		result.max_ns = samples.back();
+		result.iterations = iterations;
+		result.repetitions = repetitions;
+		results.push_back(result);
+		print(result);
+	}
+
+	void print_header() const;
+	void print(const bench_result& result) const;
+
+	// One result per line so two files diff line by line
+	bool write_json(const std::string& path) const;
+
+	// Prints the median of every case next to the one in a previous
+	// write_json file
+	void compare(const std::string& path) const;
+};
+
+// Keeps the compiler from throwing away a result nobody reads
+template <typename T>
+inline void bench_keep(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile T sink;
+	sink = value;
+#endif
+}
@@ -0,0 +1,99 @@
+#include "benchmarks.h"
+#include "chip8.h"
+#include "lanes.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+
+// instructions between timer ticks, as if running at 60000 ips
+#define LANE_CHUNK 1000
+
+// both sides run this many times, taking turns, and the best run counts,
+// so a busy moment doesn't decide which one wins
+#define LANE_ROUNDS 3
+
+// Lane l holds key l for the first half when `own_keys`, otherwise every
+// lane gets the same input and only Cxkk can tell them apart
+static uint16_t lane_keys(uint32_t lane, uint64_t chunk, uint64_t chunks, bool own_keys)
+{
+	if (chunk >= chunks / 2)
+		return 0;
+	return own_keys ? uint16_t(1u << lane) : uint16_t(1u << 5);
+}
+
+static double scalar_instructions_per_second(const std::string& rom, uint64_t chunks, bool own_keys)
+{
+	std::unique_ptr<chip8> instances[LANES];
+	for (uint32_t l = 0; l < LANES; l++)
+	{
+		instances[l] = std::make_unique<chip8>();
+		instances[l]->initialize();
+		instances[l]->load_rom(rom);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t l = 0; l < LANES; l++)
+		for (uint64_t c = 0; c < chunks; c++)
+		{
+			uint16_t keys = lane_keys(l, c, chunks, own_keys);
+			for (uint32_t k = 0; k < 16; k++)
+				instances[l]->keypad[k] = (keys >> k) & 1u;
+			instances[l]->run(LANE_CHUNK);
+			instances[l]->tick_timers();
+		}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return LANES * chunks * LANE_CHUNK / seconds;
+}
+
+static double lanes_instructions_per_second(const std::string& rom, uint64_t chunks, bool own_keys, double& lockstep)
+{
+	chip8 source;
+	source.initialize();
+	source.load_rom(rom);
+
+	std::unique_ptr<chip8_lanes> lanes = std::make_unique<chip8_lanes>();
+	for (uint32_t l = 0; l < LANES; l++)
+		lanes->set_lane(l, source);
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t c = 0; c < chunks; c++)
+	{
+		for (uint32_t l = 0; l < LANES; l++)
+			lanes->keypad[l] = lane_keys(l, c, chunks, own_keys);
+		lanes->run(LANE_CHUNK);
+		lanes->tick_timers();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	lockstep = 100.0 * lanes->lockstep_steps / (lanes->lockstep_steps + lanes->diverged_steps);
+	return LANES * chunks * LANE_CHUNK / seconds;
+}
+
+// LANES copies of every ROM, one after the other with run() against all
+// of them at once in chip8_lanes
+void bench_lanes(const std::string& path, uint64_t cycles)
+{
+	uint64_t chunks = cycles / LANE_CHUNK;
+
+	printf("\n%-24s %-9s %16s %16s %10s\n", "lanes", "input", "16x run() ins/s", "lanes ins/s", "lockstep");
+	for (const auto& game : std::filesystem::directory_iterator(path))
+	{
+		std::string rom = game.path().string();
+		for (bool own_keys : { false, true })
+		{
+			double lockstep, scalar = 0, lanes = 0;
+			for (uint32_t round = 0; round < LANE_ROUNDS; round++)
+			{
+				scalar = std::max(scalar, scalar_instructions_per_second(rom, chunks, own_keys));
+				lanes = std::max(lanes, lanes_instructions_per_second(rom, chunks, own_keys, lockstep));
+			}
+
+			printf("%-24s %-9s %16.0f %16.0f %9.1f%%\n", game.path().filename().string().c_str(),
+				own_keys ? "own keys" : "same keys", scalar, lanes, lockstep);
+		}
+	}
+}
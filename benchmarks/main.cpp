@@ -0,0 +1,147 @@
+#include "benchmarks.h"
+#include "harness.h"
+#include "chip8.h"
+#include "jit.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+// Fetches and decodes the opcode on every cycle, the way cycle() worked
+// before the pre-decoded instruction cache
+static void uncached_cycle(chip8& interpreter)
+{
+	uint16_t opcode = (interpreter.memory[interpreter.pc] << 8u) | interpreter.memory[interpreter.pc + 1];
+	interpreter.pc += 2;
+
+	interpreter.execute_instuction(opcode);
+}
+
+template <typename F>
+static double instructions_per_second(const std::string& rom, uint64_t cycles, F step)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	interpreter.load_rom(rom);
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < cycles; i++)
+		step(interpreter);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return cycles / seconds;
+}
+
+// Same as above for the engines that take a whole batch at once
+template <typename F>
+static double batch_instructions_per_second(const std::string& rom, uint64_t cycles, F run)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	interpreter.load_rom(rom);
+
+	auto start = std::chrono::steady_clock::now();
+	run(interpreter, cycles);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return cycles / seconds;
+}
+
+// Runs every ROM in the folder for a fixed number of cycles and prints
+// how many instructions per second the interpreter managed
+void bench_roms(const std::string& path, uint64_t cycles)
+{
+	printf("%-24s %16s %16s %16s %16s\n", "rom", "uncached ins/s", "cycle() ins/s", "run() ins/s", "jit ins/s");
+	for (const auto& game : std::filesystem::directory_iterator(path))
+	{
+		std::string rom = game.path().string();
+		double uncached = instructions_per_second(rom, cycles, uncached_cycle);
+		double cached = instructions_per_second(rom, cycles, [](chip8& c) { c.cycle(); });
+		double threaded = batch_instructions_per_second(rom, cycles, [](chip8& c, uint64_t n) { c.run(n); });
+		double jit = batch_instructions_per_second(rom, cycles, [](chip8& c, uint64_t n) { chip8_jit(c).run(n); });
+
+		printf("%-24s %16.0f %16.0f %16.0f %16.0f\n", game.path().filename().string().c_str(), uncached, cached, threaded, jit);
+	}
+}
+
+static void usage()
+{
+	printf("usage: benchmarks [roms folder] [options]\n");
+	printf("  --micro              only the microbenchmarks\n");
+	printf("  --filter <text>      only microbenchmarks with <text> in their name\n");
+	printf("  --repetitions <n>    timed repetitions of every microbenchmark, 7 by default\n");
+	printf("  --json <path>        writes the microbenchmark results to <path>\n");
+	printf("  --compare <path>     prints them next to an earlier --json file\n");
+	printf("  --help               this\n");
+}
+
+int main(int argc, char** argv)
+{
+	std::string roms = "../CHIP-8 Emulator/roms/";
+	std::string json_path, compare_path;
+	bool micro_only = false;
+	bool roms_given = false;
+	bench_harness harness;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--micro")
+			micro_only = true;
+		else if (arg == "--filter" && i + 1 < argc)
+			harness.filter = argv[++i];
+		else if (arg == "--repetitions" && i + 1 < argc)
+			harness.repetitions = std::max(1, atoi(argv[++i]));
+		else if (arg == "--json" && i + 1 < argc)
+			json_path = argv[++i];
+		else if (arg == "--compare" && i + 1 < argc)
+			compare_path = argv[++i];
+		else if (arg == "--help" || arg == "-h")
+		{
+			usage();
+			return 0;
+		}
+		else if (arg[0] == '-' || roms_given)
+		{
+			printf("%s: unknown option or missing value\n", arg.c_str());
+			usage();
+			return 1;
+		}
+		else
+		{
+			roms = arg;
+			roms_given = true;
+		}
+	}
+
+	// before anything runs, a wrong folder used to only show up after
+	// all the microbenchmarks
+	std::error_code error;
+	if (!std::filesystem::is_directory(roms, error))
+	{
+		printf("%s isn't a folder of roms\n", roms.c_str());
+		usage();
+		return 1;
+	}
+
+	bench_micro(harness, roms);
+	if (!json_path.empty())
+		harness.write_json(json_path);
+	if (!compare_path.empty())
+		harness.compare(compare_path);
+	if (micro_only)
+		return 0;
+
+	bench_roms(roms, 5000000);
+	bench_fusion(roms, 2000000);
+	bench_draw(2000000);
+	bench_blit();
+	bench_lanes(roms, 1000000);
+	bench_savestate(roms, 20000);
+	bench_threading(roms + "Space Invaders.ch8", 2.0);
+
+	return 0;
+}
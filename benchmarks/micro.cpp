@@ -0,0 +1,251 @@
+#include "benchmarks.h"
+#include "harness.h"
+#include "chip8.h"
+#include "framework.h"
+#include "jit.h"
+#include "listing.h"
+#include "rom_database.h"
+#include "rom_library.h"
+
+#include <cstdio>
+#include <filesystem>
+
+// One opcode out of every class execute_instuction dispatches on. The
+// registers get reset before each class and I before every call, so the
+// memory ones keep writing to the same place
+static const struct
+{
+	const char* name;
+	uint16_t opcode;
+} opcode_classes[] = {
+	{ "00E0", 0x00E0 }, { "00EE", 0x00EE }, { "1nnn", 0x1200 }, { "2nnn", 0x2200 },
+	{ "3xkk", 0x3012 }, { "4xkk", 0x4012 }, { "5xy0", 0x5010 }, { "6xkk", 0x6012 },
+	{ "7xkk", 0x7012 }, { "8xy0", 0x8010 }, { "8xy1", 0x8011 }, { "8xy2", 0x8012 },
+	{ "8xy3", 0x8013 }, { "8xy4", 0x8014 }, { "8xy5", 0x8015 }, { "8xy6", 0x8016 },
+	{ "8xy7", 0x8017 }, { "8xyE", 0x801E }, { "9xy0", 0x9010 }, { "Annn", 0xA800 },
+	{ "Bnnn", 0xB200 }, { "Cxkk", 0xC0FF }, { "Dxyn", 0xD015 }, { "Ex9E", 0xE09E },
+	{ "ExA1", 0xE0A1 }, { "Fx07", 0xF007 }, { "Fx0A", 0xF00A }, { "Fx15", 0xF015 },
+	{ "Fx18", 0xF018 }, { "Fx1E", 0xF01E }, { "Fx29", 0xF029 }, { "Fx33", 0xF033 },
+	{ "Fx55", 0xF555 }, { "Fx65", 0xF565 }
+};
+
+static void reset_registers(chip8& interpreter)
+{
+	for (uint8_t i = 0; i < 16; i++)
+		interpreter.registers[i] = i * 3 + 5;
+	interpreter.index = 0x800;
+}
+
+static void bench_opcodes(bench_harness& harness)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	interpreter.seed(1);
+
+	for (const auto& op : opcode_classes)
+	{
+		reset_registers(interpreter);
+		harness.measure(std::string("execute_instuction ") + op.name, [&]
+		{
+			interpreter.index = 0x800;
+			interpreter.execute_instuction(op.opcode);
+		});
+	}
+}
+
+// Sprites drawn by Dxyn at different heights, byte aligned or not, wrapping
+// around the right edge and clipped at the bottom
+static void bench_sprites(bench_harness& harness)
+{
+	const struct
+	{
+		const char* name;
+		uint8_t x, y;
+	} positions[] = {
+		{ "aligned", 8, 4 }, { "unaligned", 13, 9 }, { "right edge", 60, 2 }, { "bottom", 20, 28 }
+	};
+	const uint8_t heights[] = { 1, 5, 8, 15 };
+
+	chip8 interpreter;
+	interpreter.initialize();
+	for (uint32_t i = 0; i < 15; i++)
+		interpreter.memory[0x300 + i] = 0xA5 ^ (i * 0x11);
+
+	for (const auto& position : positions)
+		for (uint8_t height : heights)
+		{
+			interpreter.clear_display();
+			interpreter.index = 0x300;
+			interpreter.registers[0] = position.x;
+			interpreter.registers[1] = position.y;
+
+			char name[64];
+			snprintf(name, sizeof(name), "Dxyn %s n=%u", position.name, height);
+			uint16_t opcode = 0xD010 | height;
+			harness.measure(name, [&] { interpreter.execute_instuction(opcode); });
+		}
+}
+
+// ns per instruction of cycle() on every ROM, without timers or keys
+static void bench_cycle(bench_harness& harness, const std::string& path)
+{
+	for (const auto& game : std::filesystem::directory_iterator(path))
+	{
+		chip8 interpreter;
+		interpreter.initialize();
+		interpreter.seed(1);
+		interpreter.load_rom(game.path().string());
+
+		harness.measure("cycle " + game.path().stem().string(), [&] { interpreter.cycle(); });
+	}
+}
+
+// Turning opcodes into text, one at a time and as a listing kept up to
+// date with a 3 byte write (Fx33)
+static void bench_disassembly(bench_harness& harness, const std::string& path)
+{
+	uint16_t opcode = 0;
+	char text[DISASSEMBLY_LENGTH];
+	harness.measure("disassemble", [&] { bench_keep(disassemble(opcode++, text)); });
+
+	chip8 interpreter;
+	interpreter.initialize();
+	interpreter.load_rom(path + "Space Invaders.ch8");
+	rom_listing listing;
+	harness.measure("rom_listing build", [&] { listing.build(interpreter.memory); });
+	harness.measure("rom_listing patch", [&] { listing.patch(interpreter.memory, 0x300, 3); });
+}
+
+// Switching games: reading the file again against copying out of a
+// rom_library
+static void bench_rom_switch(bench_harness& harness, const std::string& path)
+{
+	chip8 interpreter;
+	interpreter.initialize();
+	harness.measure("load_rom file", [&] { interpreter.load_rom(path + "Space Invaders.ch8"); });
+
+	rom_library library;
+	library.open(path);
+	const rom_entry& rom = library[library.find("Space Invaders.ch8")];
+	harness.measure("load_rom library", [&] { interpreter.load_rom(library.data(rom), rom.size); });
+	harness.measure("rom_library find", [&] { bench_keep(library.find(std::string_view("Space Invaders.ch8"))); });
+}
+
+// The first time a rom gets loaded against the times after: analysing
+// it against finding what was stored, then what the analysis is used for
+static void bench_rom_database(bench_harness& harness, const std::string& path)
+{
+	rom_library library;
+	library.open(path);
+	const rom_entry& rom = library[library.find("Space Invaders.ch8")];
+	const uint8_t* data = library.data(rom);
+
+	rom_analysis analysis;
+	harness.measure("analyze_rom", [&] { analyze_rom(data, rom.size, analysis); });
+
+	std::string file = (std::filesystem::temp_directory_path() / "benchmarks.c8db").string();
+	{
+		rom_database database;
+		database.open(file);
+		for (size_t i = 0; i < library.size(); i++)
+		{
+			rom_record record{};
+			record.hash = library[i].hash;
+			record.size = library[i].size;
+			analyze_rom(library.data(library[i]), library[i].size, record.analysis);
+			record.analysis_version = ROM_ANALYSIS_VERSION;
+			database.store(record);
+		}
+		database.save();
+	}
+	{
+		rom_database database;
+		database.open(file);
+		harness.measure("rom_database find", [&] { bench_keep(database.find(rom.hash, rom.size)); });
+	}
+	std::filesystem::remove(file);
+
+	chip8 interpreter;
+	interpreter.initialize();
+	harness.measure("load_rom + predecode", [&]
+	{
+		interpreter.load_rom(data, rom.size);
+		interpreter.predecode(analysis);
+	});
+
+	chip8_jit jit(interpreter);
+	harness.measure("chip8_jit translate", [&]
+	{
+		jit.flush();
+		jit.translate(analysis);
+	});
+}
+
+/*
+	The framework calls the emulator makes every frame, drawn into a
+	320x200 buffer like the emulator's. On windows this opens a window
+	that never gets shown.
+*/
+static void bench_framework(bench_harness& harness, const std::string& font)
+{
+	fm::application app;
+	if (!app.initialize(L"benchmarks", 1280, 720, 320, 200))
+		return;
+	app.load_font(font);
+
+	harness.measure("clear", [&] { app.clear(fm::color(0x000000u)); });
+
+	fm::framebuffer screen(64, 32);
+	uint32_t pixels[64 * 32];
+	for (uint32_t i = 0; i < 64 * 32; i++)
+		pixels[i] = (i * 2654435761u) >> 31 ? 0xFFFFFFFF : 0x00000000;
+	screen.set_buffer(pixels);
+
+	harness.measure("draw_framebuffer 64x32 x1", [&] { app.draw_framebuffer(&screen, 0, 35, 1); });
+	harness.measure("draw_framebuffer 64x32 x3", [&] { app.draw_framebuffer(&screen, 0, 35, 3); });
+	harness.measure("draw_framebuffer 4 rows x3", [&] { app.draw_framebuffer(&screen, 0, 35, 3, 12, 4); });
+
+	// the same line every frame hits the span cache, 256 different ones
+	// are more than it holds
+	harness.measure("draw_text cached", [&] { app.draw_text("PC: 0x2A4  I: 0x300", 200, 100, 1, fm::color(0xFFFFFFu)); });
+	harness.measure("draw_text cached x2", [&] { app.draw_text("< Space Invaders >", 10, 180, 2, fm::color(0xFFFFFFu)); });
+	std::string texts[256];
+	for (uint32_t i = 0; i < 256; i++)
+		texts[i] = "V" + std::to_string(i % 16) + ": 0x" + std::to_string(i);
+	uint32_t next = 0;
+	harness.measure("draw_text uncached", [&] { app.draw_text(texts[next++ & 0xFFu], 200, 100, 1, fm::color(0xFFFFFFu)); });
+
+	harness.measure("draw_line horizontal", [&] { app.draw_line(fm::color(0xFFFFFFu), 10, 50, 300, 50); });
+	harness.measure("draw_line vertical", [&] { app.draw_line(fm::color(0xFFFFFFu), 191, 0, 191, 199); });
+	harness.measure("draw_line diagonal", [&] { app.draw_line(fm::color(0xFFFFFFu), 0, 0, 319, 199); });
+	harness.measure("draw_line diagonal t=3", [&] { app.draw_line(fm::color(0xFFFFFFu), 0, 0, 319, 199, 3); });
+
+	// load_texture keeps everything it loaded by path, a new application
+	// every time is the only way to read the file again
+	std::string characters = font + "characters.spr";
+	harness.measure("load_texture", [&]
+	{
+		fm::application loader;
+		bench_keep(loader.load_texture(characters)->width);
+	});
+	harness.measure("load_texture cached", [&] { bench_keep(app.load_texture(characters)->width); });
+
+	// the part of the emulator's on_create that reads the font atlas
+	harness.measure("load_font", [&]
+	{
+		fm::application loader;
+		loader.load_font(font);
+	});
+}
+
+void bench_micro(bench_harness& harness, const std::string& roms)
+{
+	harness.print_header();
+	bench_opcodes(harness);
+	bench_sprites(harness);
+	bench_cycle(harness, roms);
+	bench_disassembly(harness, roms);
+	bench_rom_switch(harness, roms);
+	bench_rom_database(harness, roms);
+	bench_framework(harness, roms + "../font/");
+}
@@ -0,0 +1,81 @@
+#include "benchmarks.h"
+#include "chip8.h"
+#include "savestate.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+
+// instructions between two snapshots
+#define SNAPSHOT_STEP 100
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double nanoseconds(bench_clock::time_point start, bench_clock::time_point end)
+{
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+/*
+	Every SNAPSHOT_STEP instructions: save a state, run on, restore it and
+	run the same stretch again, so every restore goes back a short way like
+	rewind or a search would. Then the same snapshots go into a
+	state_history to see what they cost stored and how fast any of them
+	comes back.
+*/
+void bench_savestate(const std::string& path, uint64_t snapshots)
+{
+	printf("\n%-24s %10s %10s %12s %12s %14s\n", "savestate", "save ns", "load ns", "push ns", "restore ns", "bytes/snap");
+	for (const auto& game : std::filesystem::directory_iterator(path))
+	{
+		std::unique_ptr<chip8> interpreter = std::make_unique<chip8>();
+		interpreter->initialize();
+		interpreter->load_rom(game.path().string());
+
+		uint8_t state[STATE_SIZE];
+		double save = 0.0, load = 0.0, push = 0.0;
+		state_history history;
+
+		for (uint64_t i = 0; i < snapshots; i++)
+		{
+			auto start = bench_clock::now();
+			interpreter->save_state(state);
+			auto saved = bench_clock::now();
+
+			interpreter->run(SNAPSHOT_STEP);
+
+			auto restore = bench_clock::now();
+			interpreter->load_state(state, sizeof(state));
+			auto loaded = bench_clock::now();
+
+			interpreter->run(SNAPSHOT_STEP);
+			interpreter->tick_timers();
+
+			auto pushing = bench_clock::now();
+			history.push(*interpreter);
+			auto pushed = bench_clock::now();
+
+			save += nanoseconds(start, saved);
+			load += nanoseconds(restore, loaded);
+			push += nanoseconds(pushing, pushed);
+		}
+
+		// any snapshot, in an order the caches can't guess
+		std::unique_ptr<chip8> target = std::make_unique<chip8>();
+		target->initialize();
+		double restore = 0.0;
+		uint64_t k = 1;
+		for (uint64_t i = 0; i < snapshots; i++)
+		{
+			k = (k * 6364136223846793005ull + 1442695040888963407ull);
+			auto start = bench_clock::now();
+			history.restore((k >> 33) % history.size(), *target);
+			restore += nanoseconds(start, bench_clock::now());
+		}
+
+		printf("%-24s %10.0f %10.0f %12.0f %12.0f %14.0f\n", game.path().filename().string().c_str(),
+			save / snapshots, load / snapshots, push / snapshots, restore / snapshots,
+			double(history.bytes()) / history.size());
+	}
+}
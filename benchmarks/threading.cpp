@@ -0,0 +1,71 @@
+#include "benchmarks.h"
+#include "emulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Stands in for drawing the HUD and StretchDIBits
+static void busy_wait(double seconds)
+{
+	auto end = bench_clock::now() + std::chrono::duration<double>(seconds);
+	while (bench_clock::now() < end);
+}
+
+/*
+	A ui loop like CHIP8_emulator::on_update: steps the emulation itself
+	when it isn't threaded, takes the latest frame and spends present_cost
+	seconds presenting it. Latency is the time from a frame being published
+	to it being on screen.
+*/
+static void bench_mode(const std::string& rom, bool threaded, uint32_t ips, double seconds, double present_cost)
+{
+	emulation emu;
+	emu.load_rom(rom);
+	emu.set_speed(ips);
+	if (threaded)
+		emu.start();
+
+	std::vector<double> latencies;
+	uint64_t executed = 0;
+
+	auto start = bench_clock::now();
+	auto last = start;
+	while (bench_clock::now() - start < std::chrono::duration<double>(seconds))
+	{
+		auto now = bench_clock::now();
+		if (!threaded)
+			emu.step(std::chrono::duration<float>(now - last).count());
+		last = now;
+
+		if (!emu.frames.update())
+			continue;
+
+		const emulated_frame& frame = emu.frames.front();
+		busy_wait(present_cost);
+		latencies.push_back(std::chrono::duration<double>(bench_clock::now() - frame.published).count());
+		executed = frame.executed_instructions;
+	}
+	double elapsed = std::chrono::duration<double>(bench_clock::now() - start).count();
+	emu.stop();
+
+	std::sort(latencies.begin(), latencies.end());
+	double p50 = latencies.empty() ? 0.0 : latencies[latencies.size() / 2];
+	double p99 = latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100];
+
+	printf("%-12s %10s %8zu %12.2f %12.2f %14.0f\n", threaded ? "own thread" : "ui thread",
+		ips ? std::to_string(ips).c_str() : "unlimited", latencies.size(), p50 * 1000.0, p99 * 1000.0, executed / elapsed);
+}
+
+void bench_threading(const std::string& rom, double seconds)
+{
+	const double present_cost = 0.004;
+
+	printf("\n%-12s %10s %8s %12s %12s %14s  (present %.0f ms)\n", "threading", "ips", "frames", "p50 ms", "p99 ms", "ins/s", present_cost * 1000.0);
+	for (uint32_t ips : { 700u, 1000000u, 0u })
+		for (bool threaded : { false, true })
+			bench_mode(rom, threaded, ips, seconds, present_cost);
+}
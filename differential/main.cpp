@@ -0,0 +1,309 @@
+#include "analysis.h"
+#include "chip8.h"
+#include "jit.h"
+#include "lanes.h"
+#include "random.h"
+#include "savestate.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+	Runs the same rom through every way this tree has of executing CHIP-8
+	code and checks they never disagree: cycle() one instruction at a time,
+	the threaded run() loop with its superinstructions, the JIT and run()
+	after predecode. All of them are told they have to give the same result
+	as cycle(), this is where that gets checked.
+
+	Every instance gets the same seed, the same chunks of instructions, the
+	same timer ticks and the same key changes, and the save states of all
+	of them are compared after every chunk. The bundled roms also go
+	through chip8_lanes, see compare_lanes().
+
+	differential [roms folder] [options]
+	  --instructions <n>   per rom and seed, 2000000 by default
+	  --seeds <n>          seeds per rom, 5 by default
+	  --random <n>         also that many roms of random bytes, 20 by default
+
+	Exits with 1 when any engine disagrees with cycle().
+*/
+
+// Random roms stop being compared once pc or I get so close to the end of
+// memory that the next instruction could read or write past it
+#define RANDOM_LAST_PC 0xFFC
+#define RANDOM_LAST_INDEX 0xFF0
+
+struct engine
+{
+	const char* name;
+	std::unique_ptr<chip8> interpreter;
+	std::unique_ptr<chip8_jit> jit;
+	std::function<void(engine&, uint64_t)> run;
+};
+
+static std::vector<engine> create_engines(const uint8_t* rom, size_t size, uint64_t seed)
+{
+	std::vector<engine> engines;
+	engines.push_back({ "cycle()", nullptr, nullptr,
+		[](engine& e, uint64_t n) { for (uint64_t i = 0; i < n; i++) e.interpreter->cycle(); } });
+	engines.push_back({ "run()", nullptr, nullptr,
+		[](engine& e, uint64_t n) { e.interpreter->run(n); } });
+	engines.push_back({ "jit", nullptr, nullptr,
+		[](engine& e, uint64_t n) { e.jit->run(n); } });
+	engines.push_back({ "predecode + run()", nullptr, nullptr,
+		[](engine& e, uint64_t n) { e.interpreter->run(n); } });
+
+	for (engine& e : engines)
+	{
+		e.interpreter = std::make_unique<chip8>();
+		e.interpreter->initialize();
+		e.interpreter->seed(seed);
+		e.interpreter->load_rom(rom, size);
+	}
+
+	engines[2].jit = std::make_unique<chip8_jit>(*engines[2].interpreter);
+
+	rom_analysis analysis;
+	analyze_rom(rom, size, analysis);
+	engines[3].interpreter->predecode(analysis);
+
+	return engines;
+}
+
+// First byte where two save states differ, in the words of savestate.h
+static void print_difference(const uint8_t* expected, const uint8_t* got, size_t size)
+{
+	size_t at = 0;
+	while (at < size && expected[at] == got[at])
+		at++;
+
+	const char* part = "header";
+	if (at >= STATE_RANDOM_OFFSET) part = "Cxkk generator";
+	else if (at >= STATE_DISPLAY_OFFSET) part = "display";
+	else if (at >= STATE_KEYPAD_OFFSET) part = "keypad";
+	else if (at >= STATE_CPU_OFFSET) part = "pc, I, stack or timers";
+	else if (at >= STATE_MEMORY_OFFSET) part = "memory";
+	else if (at >= STATE_REGISTERS_OFFSET) part = "registers";
+	printf("    first difference at byte %zu (%s): %02x instead of %02x\n", at, part, got[at], expected[at]);
+}
+
+/*
+	Runs one rom on every engine, returns false at the first disagreement.
+	`chunk` is the most instructions run in one go, random roms go one at
+	a time so the bounds check comes before every instruction.
+*/
+static bool compare(const std::string& name, const uint8_t* rom, size_t size, uint64_t seed,
+	uint64_t instructions, uint32_t chunk, bool random_rom)
+{
+	std::vector<engine> engines = create_engines(rom, size, seed);
+
+	// the schedule gets its own generator, the engines' Cxkk state stays untouched
+	uint32_t schedule[4];
+	random_seed(schedule, seed ^ 0x5EEDull);
+	auto next = [&](uint32_t bound) { return random_next(schedule[0], schedule[1], schedule[2], schedule[3]) % bound; };
+
+	std::vector<uint8_t> expected(STATE_SIZE), got(STATE_SIZE);
+	uint64_t done = 0;
+	while (done < instructions)
+	{
+		chip8& reference = *engines[0].interpreter;
+		if (random_rom && (reference.pc > RANDOM_LAST_PC || reference.index > RANDOM_LAST_INDEX))
+			break;
+
+		uint64_t n = std::min<uint64_t>(1 + next(chunk), instructions - done);
+		bool tick = next(4) == 0;
+		bool change_key = next(16) == 0;
+		uint32_t key = next(16);
+		uint8_t down = next(2);
+
+		for (engine& e : engines)
+		{
+			e.run(e, n);
+			if (tick)
+				e.interpreter->tick_timers();
+			if (change_key)
+				e.interpreter->keypad[key] = down;
+		}
+		done += n;
+
+		reference.save_state(expected.data());
+		for (size_t i = 1; i < engines.size(); i++)
+		{
+			engines[i].interpreter->save_state(got.data());
+			if (memcmp(expected.data(), got.data(), STATE_SIZE) != 0)
+			{
+				printf("%-24s seed %llu: %s disagrees with cycle() after %llu instructions (pc %03X, expected %03X)\n",
+					name.c_str(), (unsigned long long)seed, engines[i].name, (unsigned long long)done,
+					engines[i].interpreter->pc, reference.pc);
+				print_difference(expected.data(), got.data(), STATE_SIZE);
+				return false;
+			}
+		}
+	}
+
+	if (!random_rom)
+		printf("%-24s seed %llu: %llu instructions, all engines agree\n", name.c_str(),
+			(unsigned long long)seed, (unsigned long long)done);
+	return true;
+}
+
+/*
+	chip8_lanes against LANES instances stepped with cycle(). Every lane
+	has a seed of its own and gets its own key changes, so the lanes go
+	apart and meet again, and every lane is compared after every chunk.
+*/
+static bool compare_lanes(const std::string& name, const uint8_t* rom, size_t size, uint64_t seed,
+	uint64_t instructions, uint32_t chunk)
+{
+	std::unique_ptr<chip8> references[LANES];
+	std::unique_ptr<chip8_lanes> lanes = std::make_unique<chip8_lanes>();
+	for (uint32_t l = 0; l < LANES; l++)
+	{
+		references[l] = std::make_unique<chip8>();
+		references[l]->initialize();
+		references[l]->seed(seed * LANES + l);
+		references[l]->load_rom(rom, size);
+		lanes->set_lane(l, *references[l]);
+	}
+
+	uint32_t schedule[4];
+	random_seed(schedule, seed ^ 0x1A4E5ull);
+	auto next = [&](uint32_t bound) { return random_next(schedule[0], schedule[1], schedule[2], schedule[3]) % bound; };
+
+	std::vector<uint8_t> expected(STATE_SIZE), got(STATE_SIZE);
+	chip8 lane;
+	uint64_t done = 0;
+	while (done < instructions)
+	{
+		uint64_t n = std::min<uint64_t>(1 + next(chunk), instructions - done);
+		bool tick = next(4) == 0;
+
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			for (uint64_t i = 0; i < n; i++)
+				references[l]->cycle();
+			if (tick)
+				references[l]->tick_timers();
+		}
+		lanes->run(n);
+		if (tick)
+			lanes->tick_timers();
+		done += n;
+
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			references[l]->save_state(expected.data());
+			lanes->get_lane(l, lane);
+			lane.save_state(got.data());
+			if (memcmp(expected.data(), got.data(), STATE_SIZE) != 0)
+			{
+				printf("%-24s seed %llu: lane %u of chip8_lanes disagrees with cycle() after %llu instructions (pc %03X, expected %03X)\n",
+					name.c_str(), (unsigned long long)seed, l, (unsigned long long)done, lane.pc, references[l]->pc);
+				print_difference(expected.data(), got.data(), STATE_SIZE);
+				return false;
+			}
+		}
+
+		for (uint32_t l = 0; l < LANES; l++)
+		{
+			if (next(16) != 0)
+				continue;
+			uint32_t key = next(16);
+			uint8_t down = next(2);
+			references[l]->keypad[key] = down;
+			lanes->keypad[l] = uint16_t((lanes->keypad[l] & ~(1u << key)) | (down << key));
+		}
+	}
+
+	printf("%-24s seed %llu: %u lanes, %.1f%% in lockstep, all lanes agree\n", name.c_str(), (unsigned long long)seed, LANES,
+		100.0 * lanes->lockstep_steps / (lanes->lockstep_steps + lanes->diverged_steps));
+	return true;
+}
+
+static std::vector<uint8_t> read_file(const std::filesystem::path& path)
+{
+	std::vector<uint8_t> data;
+	FILE* file = fopen(path.string().c_str(), "rb");
+	if (!file)
+		return data;
+
+	fseek(file, 0, SEEK_END);
+	data.resize(ftell(file));
+	fseek(file, 0, SEEK_SET);
+	data.resize(fread(data.data(), 1, data.size(), file));
+	fclose(file);
+	return data;
+}
+
+int main(int argc, char** argv)
+{
+	std::string roms = "../CHIP-8 Emulator/roms/";
+	uint64_t instructions = 2000000;
+	uint32_t seeds = 5;
+	uint32_t random_roms = 20;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--instructions" && i + 1 < argc)
+			instructions = strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--seeds" && i + 1 < argc)
+			seeds = atoi(argv[++i]);
+		else if (arg == "--random" && i + 1 < argc)
+			random_roms = atoi(argv[++i]);
+		else
+			roms = arg;
+	}
+
+#if !CHIP8_JIT_AVAILABLE
+	printf("no JIT on this architecture, chip8_jit::run only calls the interpreter\n");
+#endif
+
+	uint32_t failed = 0, checked = 0;
+	std::error_code error;
+	for (const auto& game : std::filesystem::directory_iterator(roms, error))
+	{
+		std::vector<uint8_t> rom = read_file(game.path());
+		if (rom.empty())
+			continue;
+
+		for (uint32_t seed = 1; seed <= seeds; seed++)
+		{
+			failed += !compare(game.path().filename().string(), rom.data(), rom.size(), seed, instructions, 300, false);
+			failed += !compare_lanes(game.path().filename().string(), rom.data(), rom.size(), seed, instructions, 300);
+			checked += 2;
+		}
+	}
+	if (error)
+		printf("can't read %s: %s\n", roms.c_str(), error.message().c_str());
+
+	uint32_t generator[4];
+	random_seed(generator, 0xC8);
+	std::vector<uint8_t> rom(PROGRAM_SIZE);
+	uint32_t random_failed = 0;
+
+	// random bytes are full of opcodes that don't exist and op_invalid
+	// would print every one of them
+	std::streambuf* out = std::cout.rdbuf(nullptr);
+	for (uint32_t i = 0; i < random_roms; i++)
+	{
+		for (uint8_t& byte : rom)
+			byte = random_byte(generator);
+		random_failed += !compare("random rom " + std::to_string(i), rom.data(), rom.size(), i + 1, instructions, 1, true);
+	}
+	std::cout.rdbuf(out);
+	if (random_roms)
+		printf("%u random roms, %u disagreements\n", random_roms, random_failed);
+
+	failed += random_failed;
+	checked += random_roms;
+	printf("%u runs, %u failed\n", checked, failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+project "differential"
+	kind "ConsoleApp"
+	language "C++"
+	cppdialect "C++20"
+	staticruntime "on"
+
+	targetdir ("%{wks.location}/bin/" .. outputdir .. "/%{prj.name}")
+	objdir ("%{wks.location}/bin-int/" .. outputdir .. "/%{prj.name}")
+
+	includedirs
+	{
+		"../CHIP-8 Emulator"
+	}
+
+	files
+	{
+		"**.h",
+		"**.cpp",
+		"../CHIP-8 Emulator/**.h",
+		"../CHIP-8 Emulator/**.cpp"
+	}
+
+	-- the emulator's own entry point
+	removefiles
+	{
+		"../CHIP-8 Emulator/main.cpp"
+	}
+
+	filter "system:windows"
+		systemversion "latest"
+		defines { "_CRT_SECURE_NO_WARNINGS" }
+
+	filter "configurations:Debug"
+		runtime "Debug"
+		symbols "on"
+
+	filter "configurations:Release"
+		runtime "Release"
+		optimize "on"
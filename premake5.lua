@@ -1,12 +1,53 @@
+newoption
+{
+	trigger = "avx2",
+	description = "Let the compiler use AVX2, fm::blit_scaled and chip8_lanes pick it up"
+}
+
+newoption
+{
+	trigger = "profile",
+	description = "Count executed instructions per opcode and address (CHIP8_PROFILE)"
+}
+
 workspace "CHIP-8 Emulator"
-	architecture "x86"
 	configurations { "Debug", "Release" }
+	platforms { "x86", "x64" }
 	startproject "CHIP-8 Emulator"
 	flags
 	{
 		"MultiProcessorCompile"
 	}
 
+	-- the JIT backend (jit.cpp) only translates code on x64
+	filter "platforms:x86"
+		architecture "x86"
+
+	filter "platforms:x64"
+		architecture "x86_64"
+
+	filter "options:avx2"
+		vectorextensions "AVX2"
+
+	filter "options:profile"
+		defines { "CHIP8_PROFILE=1" }
+
+	-- waveOut, see fm::application::open_audio
+	filter "system:windows"
+		links { "winmm" }
+
+	-- no window on linux, framework.h builds its headless backend
+	-- (premake5 gmake2, then run from "CHIP-8 Emulator" so font/ and roms/ are found)
+	filter "system:linux"
+		toolset "gcc"
+		defines { "FM_HEADLESS" }
+		links { "pthread" }
+
+	filter {}
+
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 
-include "CHIP-8 Emulator"
\ No newline at end of file
+include "CHIP-8 Emulator"
+include "benchmarks"
+include "batch-runner"
+include "differential"
\ No newline at end of file